@@ -3,6 +3,10 @@
 #include "ShaderSystem.hpp"
 #include "KeyboardController.hpp"
 #include "VulkanBufferObjects.hpp"
+#include "ModelBatchBuilder.hpp"
+#include "VulkanLayoutCache.hpp"
+#include "ShaderModuleCache.hpp"
+#include "ShaderWatcher.hpp"
 
 
 #define GLM_FORCE_RADIANS
@@ -15,6 +19,8 @@
 #include <array>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <iostream>
 #include <numeric>
 
 namespace vlkn {
@@ -29,9 +35,21 @@ namespace vlkn {
 
     App::App()
     {
-        GlobalPool = VulkanDescriptorPool::Builder(Device).SetMaxSets(Swapchain::MAX_FRAMES_IN_FLIGHT)
-            .AddPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, Swapchain::MAX_FRAMES_IN_FLIGHT).Build();
+        for (uint32_t i = 0; i < Frames.GetFramesInFlight(); i++)
+        {
+            FrameDescriptors.push_back(std::make_unique<VulkanDescriptorAllocator>(Device));
+        }
         LoadGameObjects();
+
+        auto MemoryStats = Device.getMemoryStats();
+        std::cout << "Device memory: " << MemoryStats.AllocationCount << " allocations in "
+            << MemoryStats.VkAllocationCount << " device memory objects, "
+            << MemoryStats.BytesInUse / 1024 << " KiB used of " << MemoryStats.BytesReserved / 1024 << " KiB reserved\n";
+
+        auto GeometryStats = Geometry.GetStats();
+        std::cout << "Geometry pool: " << GeometryStats.AllocationCount << " meshes, "
+            << GeometryStats.VerticesInUse << "/" << GeometryStats.VertexCapacity << " vertices, "
+            << GeometryStats.IndicesInUse << "/" << GeometryStats.IndexCapacity << " indices\n";
     }
 
     App::~App()
@@ -42,29 +60,93 @@ namespace vlkn {
 
 void App::run()
 {
-    std::vector<std::unique_ptr<VulkanBufferObjects>> uboBuffers(Swapchain::MAX_FRAMES_IN_FLIGHT);
-    for (int i = 0; i < uboBuffers.size(); i++) {
-        uboBuffers[i] = std::make_unique<VulkanBufferObjects>(
-            Device,
-            sizeof(GlobalUBO),
-            1,
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-        uboBuffers[i]->Map();
-    }
-    
+    // Every frame's GlobalUBO lives in the frame allocator; one descriptor set covers all of them.
     auto GlobalSetLayout = VulkanDescriptorSetLayout::Builder(Device)
-        .AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,  VK_SHADER_STAGE_ALL_GRAPHICS).Build();
-
-    std::vector<VkDescriptorSet> GlobalDescriptorSets(Swapchain::MAX_FRAMES_IN_FLIGHT);
-
-    for (int i = 0; i < GlobalDescriptorSets.size(); i++)
+        .AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,  VK_SHADER_STAGE_ALL_GRAPHICS).Build();
+
+    VkDescriptorSet GlobalDescriptorSet;
+    auto BufferInfo = FrameUniforms.DescriptorInfo(sizeof(GlobalUBO));
+    VulkanDescriptorWriter(*GlobalSetLayout, GlobalDescriptors).WriteBuffer(0, &BufferInfo).Build(GlobalDescriptorSet);
+
+	ShaderSystem ShaderSys{Device, renderer.GetSwapchainRenderTarget(), GlobalSetLayout->GetDescriptorSetLayout(), Pipelines,
+        Jobs, Frames, USE_DYNAMIC_RENDER_STATE};
+
+    // Registered after the frame allocator's, so its buffer has already been recreated when the set is rewritten.
+    auto FramesRegistration = Frames.Register([&](uint32_t frameCount) {
+        FrameDescriptors.resize(frameCount);
+        for (auto& Allocator : FrameDescriptors)
+        {
+            if (!Allocator)
+            {
+                Allocator = std::make_unique<VulkanDescriptorAllocator>(Device);
+            }
+        }
+        auto ResizedInfo = FrameUniforms.DescriptorInfo(sizeof(GlobalUBO));
+        VulkanDescriptorWriter(*GlobalSetLayout, GlobalDescriptors).WriteBuffer(0, &ResizedInfo).Overwrite(GlobalDescriptorSet);
+    });
+    ShaderSys.PrewarmVariants(GameObjects);
+    if (PIPELINE_BENCHMARK_COPIES > 0)
     {
-        auto BufferInfo = uboBuffers[i]->DescriptorInfo();
-        VulkanDescriptorWriter(*GlobalSetLayout, *GlobalPool).WriteBuffer(0, &BufferInfo).Build(GlobalDescriptorSets[i]);
+        auto Result = Compiler.Benchmark([&]() {
+            std::vector<PipelineCompiler::Request> Requests;
+            for (int i = 0; i < PIPELINE_BENCHMARK_COPIES; i++)
+            {
+                for (auto& Req : ShaderSys.GetPipelineRequests(renderer.GetSwapchainRenderTarget()))
+                {
+                    Requests.push_back(std::move(Req));
+                }
+            }
+            return Requests;
+        });
+        std::cout << "Pipeline benchmark: " << Result.PipelineCount << " pipelines, serial " << Result.SerialMs
+            << " ms, parallel " << Result.ParallelMs << " ms on " << Result.ThreadCount << " thread(s)\n";
+    }
+    ShaderSys.SetRecordingThreads(RECORDING_THREADS);
+    if (RECORDING_BENCHMARK)
+    {
+        std::shared_ptr<Model> BenchmarkModel;
+        for (auto& kv : GameObjects)
+        {
+            if (kv.second.Model != nullptr)
+            {
+                BenchmarkModel = kv.second.Model;
+                break;
+            }
+        }
+
+        Camera BenchmarkCamera{};
+        for (int ObjectCount : { 10000, 100000 })
+        {
+            GameObject::Map BenchmarkObjects;
+            for (int i = 0; i < ObjectCount; i++)
+            {
+                auto Obj = GameObject::CreateGameObject();
+                Obj.Model = BenchmarkModel;
+                BenchmarkObjects.emplace(Obj.GetId(), std::move(Obj));
+            }
+
+            // No frame is in flight yet, so frame 0's resources are free to record into.
+            FrameInfo BenchmarkFrame{ 0, 0.0f, VK_NULL_HANDLE, BenchmarkCamera, GlobalDescriptorSet, 0, BenchmarkObjects, Geometry,
+                *FrameDescriptors[0], renderer.GetSwapchainExtent() };
+            auto Result = ShaderSys.BenchmarkRecording(BenchmarkFrame);
+            std::cout << "Recording benchmark: " << Result.ObjectCount << " objects, single thread " << Result.SingleThreadMs
+                << " ms, parallel " << Result.ParallelMs << " ms on " << Result.ThreadCount << " thread(s)\n";
+        }
+    }
+    const char* DrawPathNames[] = { "direct", "indirect", "instanced" };
+    std::cout << "Rendering: " << (renderer.UsesDynamicRendering() ? "dynamic rendering" : "render pass") << "\n";
+    std::cout << "Pipeline build: " << (Compiler.UsesLibraries() ? "graphics pipeline libraries" : "monolithic") << "\n";
+    std::cout << "Render state: " << (ShaderSys.UsesDynamicRenderState() ? "dynamic" : "baked into pipelines") << "\n";
+    std::cout << "Job system: " << Jobs.GetThreadCount() << " thread(s), recording on up to " << ShaderSys.GetRecordingThreads() << "\n";
+    std::cout << "Draw path: " << DrawPathNames[static_cast<int>(ShaderSys.GetDrawPath())] << "\n";
+    std::cout << "Frames in flight: " << Frames.GetFramesInFlight() << ", synchronized with "
+        << (Frames.UsesTimeline() ? "a timeline semaphore" : "fences") << "\n";
+    std::unique_ptr<ShaderWatcher> Watcher;
+    if (ENABLE_SHADER_HOT_RELOAD)
+    {
+        Watcher = std::make_unique<ShaderWatcher>("shaders");
     }
 
-	ShaderSystem ShaderSys{Device, renderer.GetSwapchainRenderPass(), GlobalSetLayout->GetDescriptorSetLayout()};
     Camera camera{};
     //camera.SetViewDir(glm::vec3(0.0f, -0.5f, -2.0f), glm::vec3(0.0f, 0.0f, 2.5f));
     
@@ -74,10 +156,40 @@ void App::run()
 
     auto CurrentTime = std::chrono::high_resolution_clock::now();
 
+    // Rebuilt every frame, as the tasks capture that frame's state. Task timings are summed across frames.
+    TaskGraph FrameGraph;
+    std::vector<TaskGraph::TaskTiming> TaskTotals;
+    uint64_t ProfiledFrames = 0;
+
 	while (!window.ShouldClose())
 	{
 		glfwPollEvents();
 
+        if (Watcher)
+        {
+            auto Recompiled = Watcher->TakeRecompiled();
+            if (!Recompiled.empty())
+            {
+                ShaderSys.RequestReload(Recompiled);
+            }
+        }
+
+        // Applied by the renderer at the start of the next frame.
+        for (uint32_t Count = FrameResources::MIN_FRAMES_IN_FLIGHT; Count <= FrameResources::MAX_FRAMES_IN_FLIGHT; Count++)
+        {
+            if (glfwGetKey(window.getWindowHandle(), GLFW_KEY_0 + Count) == GLFW_PRESS)
+            {
+                renderer.RequestFramesInFlight(Count);
+            }
+        }
+        for (int Policy = 0; Policy < PRESENT_POLICY_COUNT; Policy++)
+        {
+            if (glfwGetKey(window.getWindowHandle(), GLFW_KEY_F1 + Policy) == GLFW_PRESS)
+            {
+                renderer.SetPresentSettings({ static_cast<PresentPolicy>(Policy), SWAPCHAIN_IMAGES });
+            }
+        }
+
         auto NewTime = std::chrono::high_resolution_clock::now();
         float FrameTime = std::chrono::duration<float, std::chrono::seconds::period>(NewTime - CurrentTime).count();
         CurrentTime = NewTime;
@@ -95,23 +207,104 @@ void App::run()
 		if (auto CommandBuffer = renderer.BeginFrame())
 		{
             int FrameIndex = renderer.GetFrameIndex();
+            ShaderSys.ApplyPendingReload();
+            Geometry.AdvanceFrame();
+            FrameUniforms.BeginFrame(FrameIndex);
+            FrameDescriptors[FrameIndex]->Reset();
+
+            // The offset is filled in by the uniforms task.
+            FrameInfo frameInfo{ FrameIndex, FrameTime, CommandBuffer, camera, GlobalDescriptorSet, 0, GameObjects, Geometry,
+                *FrameDescriptors[FrameIndex], renderer.GetSwapchainExtent() };
+
+            // Input and the camera stay on this thread above, as GLFW may only be used from the main thread.
+            FrameGraph.Clear();
+            auto UpdateUniforms = FrameGraph.Add("Uniforms", [&]() {
+                GlobalUBO ubo{};
+                ubo.ProjectionView = camera.GetProjMat() * camera.GetViewMat();
+                frameInfo.GlobalUboOffset = FrameUniforms.Push(ubo);
+                FrameUniforms.Flush();
+            });
+            auto PrepareDraws = FrameGraph.Add("Prepare draws", [&]() { ShaderSys.PrepareFrame(frameInfo); });
+            FrameGraph.Add("Record", [&]() {
+                renderer.BeginSwapchainRenderPass(CommandBuffer, ShaderSys.RecordsInSecondaries());
+                ShaderSys.RenderGameObjects(frameInfo);
+                renderer.EndSwapchainRenderPass(CommandBuffer);
+            }, { UpdateUniforms, PrepareDraws });
+            Jobs.Run(FrameGraph);
+
+            auto Timings = FrameGraph.GetTimings();
+            TaskTotals.resize(Timings.size());
+            for (size_t i = 0; i < Timings.size(); i++)
+            {
+                TaskTotals[i].Name = Timings[i].Name;
+                TaskTotals[i].DurationMs += Timings[i].DurationMs;
+            }
+            ProfiledFrames++;
 
-            FrameInfo frameInfo{ FrameIndex, FrameTime, CommandBuffer, camera, GlobalDescriptorSets[FrameIndex], GameObjects };
-
-            //Update Buffers
-            GlobalUBO ubo{};
-            ubo.ProjectionView = camera.GetProjMat() * camera.GetViewMat();
-            uboBuffers[FrameIndex]->WriteToBuffer(&ubo);
-            uboBuffers[FrameIndex]->Flush();
-            //Render
-			renderer.BeginSwapchainRenderPass(CommandBuffer);
-			ShaderSys.RenderGameObjects(frameInfo);
-			renderer.EndSwapchainRenderPass(CommandBuffer);
 			renderer.EndFrame();
 		}
 	}
 
 	vkDeviceWaitIdle(Device.device());
+
+    uint64_t TransientSets = 0;
+    uint32_t TransientPools = 0;
+    for (auto& Allocator : FrameDescriptors)
+    {
+        TransientSets += Allocator->GetStats().SetsAllocated;
+        TransientPools += Allocator->GetStats().PoolsCreated;
+    }
+    std::cout << "Descriptor sets: " << GlobalDescriptors.GetStats().SetsAllocated << " persistent in "
+        << GlobalDescriptors.GetStats().PoolsCreated << " pool(s), " << TransientSets << " transient in "
+        << TransientPools << " pool(s)\n";
+
+    auto LayoutStats = Device.layoutCache().GetStats();
+    std::cout << "Layout cache: " << LayoutStats.SetLayoutsCreated << "/" << LayoutStats.SetLayoutRequests
+        << " set layouts created, " << LayoutStats.PipelineLayoutsCreated << "/" << LayoutStats.PipelineLayoutRequests
+        << " pipeline layouts created\n";
+
+    auto PipelineStats = Pipelines.GetStats();
+    std::cout << "Pipelines: " << PipelineStats.UniquePipelines << " unique PSOs for " << PipelineStats.Requests
+        << " requests (" << PipelineStats.Deduplicated << " deduplicated), " << ShaderSys.GetVariantCount() << " shader variants\n";
+
+    auto ShaderStats = Device.shaderModuleCache().GetStats();
+    std::cout << "Shader modules: " << ShaderStats.ModulesCreated << " created, " << ShaderStats.ModulesShared
+        << " shared across " << ShaderStats.Requests << " loads ("
+        << (Device.shaderModuleCache().UsesModuleObjects() ? "module objects" : "maintenance5 inline SPIR-V") << ")\n";
+
+    auto CompileTimings = Compiler.GetTimings();
+    std::cout << "Pipeline compiles: " << CompileTimings.MonolithicPipelines << " monolithic in " << CompileTimings.MonolithicMs << " ms\n";
+    if (Compiler.UsesLibraries())
+    {
+        const auto& LibraryStats = CompileTimings.Libraries;
+        std::cout << "Pipeline libraries: " << LibraryStats.LibrariesCreated << " compiled in " << LibraryStats.LibraryCompileMs
+            << " ms (" << LibraryStats.LibrariesShared << " shared), " << LibraryStats.FastLinks << " fast links in "
+            << LibraryStats.FastLinkMs << " ms, " << LibraryStats.OptimizedLinks << " optimized links in "
+            << LibraryStats.OptimizedLinkMs << " ms\n";
+    }
+    if (ProfiledFrames > 0)
+    {
+        std::cout << "Frame tasks (average over " << ProfiledFrames << " frames):";
+        for (const auto& Task : TaskTotals)
+        {
+            std::cout << " " << Task.Name << " " << Task.DurationMs / ProfiledFrames << " ms;";
+        }
+        std::cout << "\n";
+    }
+    if (ShaderSys.UsesDynamicRenderState())
+    {
+        std::cout << "Render state commands: " << ShaderSys.GetRenderStateCommandCount() << "\n";
+    }
+    for (int Policy = 0; Policy < PRESENT_POLICY_COUNT; Policy++)
+    {
+        auto Latency = renderer.GetPresentLatency(static_cast<PresentPolicy>(Policy));
+        if (Latency.FrameCount > 0)
+        {
+            std::cout << "Input latency (" << presentPolicyName(static_cast<PresentPolicy>(Policy)) << "): average "
+                << Latency.TotalMs / Latency.FrameCount << " ms, max " << Latency.MaxMs << " ms over " << Latency.FrameCount << " frames"
+                << (renderer.IsPresentLatencyApproximate() ? " (approximate, completion seen at frame boundaries)" : "") << "\n";
+        }
+    }
 }
 
 }
@@ -122,7 +315,16 @@ namespace vlkn {
 
     void App::LoadGameObjects()
     {
-        std::shared_ptr<Model> model = Model::CreateModelFromObj(Device, "./models/smooth_vase.obj");
+        ModelBatchBuilder Batch{ Geometry };
+        auto Models = Batch.AddFromObj("./models/smooth_vase.obj")
+            .AddFromObj("./models/quad.obj")
+            .Build();
+
+        const auto& BatchStats = Batch.GetStats();
+        std::cout << "Model batch: " << BatchStats.ModelCount << " models, " << BatchStats.BytesUploaded / 1024 << " KiB in "
+            << BatchStats.SubmitCount << " submit(s). Load " << BatchStats.LoadMs << " ms, record " << BatchStats.RecordMs
+            << " ms, submit " << BatchStats.SubmitMs << " ms\n";
+        std::shared_ptr<Model> model = Models[0];
 
         auto GameObj = GameObject::CreateGameObject();
         GameObj.Model = model;
@@ -131,12 +333,23 @@ namespace vlkn {
         GameObj.Transform.Scale = { 0.5f, 0.5f, 0.5f };
         GameObjects.emplace(GameObj.GetId(),std::move(GameObj));
 
-        model = Model::CreateModelFromObj(Device, "./models/quad.obj");
+        model = Models[1];
         auto Floor = GameObject::CreateGameObject();
         Floor.Model = model;
 
         Floor.Transform.Translation = { 0.0f, 0.5f, 0.0f };
         Floor.Transform.Scale = { 3.0f, 0.5f, 3.0f };
         GameObjects.emplace(Floor.GetId(), std::move(Floor));
+
+        // Extra copies of the vase sharing one Model, laid out on a grid behind the scene.
+        int GridSide = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(STRESS_TEST_VASES))));
+        for (int i = 0; i < STRESS_TEST_VASES; i++)
+        {
+            auto Vase = GameObject::CreateGameObject();
+            Vase.Model = Models[0];
+            Vase.Transform.Translation = { 0.25f * (i % GridSide - GridSide / 2), 0.5f, 1.5f + 0.25f * (i / GridSide) };
+            Vase.Transform.Scale = { 0.1f, 0.1f, 0.1f };
+            GameObjects.emplace(Vase.GetId(), std::move(Vase));
+        }
     }
 }
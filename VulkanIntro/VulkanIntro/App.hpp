@@ -4,7 +4,13 @@
 #include "VulkanDevice.hpp"
 #include "Renderer.hpp"
 #include "GameObject.hpp"
+#include "GeometryPool.hpp"
+#include "FrameAllocator.hpp"
+#include "FrameResources.hpp"
+#include "JobSystem.hpp"
 #include "VulkanDescriptors.hpp"
+#include "PipelineCompiler.hpp"
+#include "PipelineRegistry.hpp"
 
 #include <memory>
 #include <vector>
@@ -14,6 +20,42 @@ namespace vlkn {
 	public:
 		static constexpr int WIDTH = 800;
 		static constexpr int HEIGHT = 600;
+		// Number of extra vases to spawn for stress testing the instanced draw path, e.g. 100000.
+		static constexpr int STRESS_TEST_VASES = 0;
+		// When non-zero, the shader system's pipeline set is built this many times serially and in parallel
+		// at startup and the timings are logged.
+		static constexpr int PIPELINE_BENCHMARK_COPIES = 0;
+		// Recompile and swap in shaders edited in the shaders directory while the app is running. A developer
+		// feature that runs glslc, so only debug builds have it.
+#ifdef NDEBUG
+		static constexpr bool ENABLE_SHADER_HOT_RELOAD = false;
+#else
+		static constexpr bool ENABLE_SHADER_HOT_RELOAD = true;
+#endif
+		// Fast-link pipelines from VK_EXT_graphics_pipeline_library parts when the device supports it.
+		static constexpr bool USE_GRAPHICS_PIPELINE_LIBRARY = true;
+		// Render with vkCmdBeginRendering instead of a VkRenderPass and framebuffers when the device supports it.
+		static constexpr bool USE_DYNAMIC_RENDERING = true;
+		// Set cull mode, front face, topology and depth state per draw from each object's RenderState, so
+		// objects that only differ in that state share pipelines. Needs a Vulkan 1.3 device.
+		static constexpr bool USE_DYNAMIC_RENDER_STATE = false;
+		// Job system threads recording the direct draw path into secondary command buffers; 1 records it inline
+		// into the frame's command buffer and 0 uses all of them.
+		static constexpr uint32_t RECORDING_THREADS = 1;
+		// Time recording the direct path at 10k and 100k objects on one thread and on every recording thread
+		// at startup and log the timings.
+		static constexpr bool RECORDING_BENCHMARK = false;
+		// Frames the CPU may record ahead of the GPU, 1 to 4. Fewer lower input latency, more keep the GPU fed
+		// when CPU frame times vary. Keys 1 to 4 change it while running.
+		static constexpr uint32_t FRAMES_IN_FLIGHT = FrameResources::DEFAULT_FRAMES_IN_FLIGHT;
+		// Synchronize frames with one timeline semaphore counting frame numbers instead of per-frame and
+		// per-image fences, when the device supports Vulkan 1.2.
+		static constexpr bool USE_TIMELINE_SEMAPHORES = true;
+		// How frames are presented at startup; F1 to F5 switch between the policies while running. The
+		// average input latency of each policy used is logged at exit.
+		static constexpr PresentPolicy PRESENT_POLICY = PresentPolicy::Mailbox;
+		// Swapchain images, 0 for the policy's default.
+		static constexpr uint32_t SWAPCHAIN_IMAGES = 0;
 
 		App();
 		~App();
@@ -27,9 +69,16 @@ namespace vlkn {
 
 		Window window{WIDTH, HEIGHT, "Vulkan Window"};
 		VulkanDevice Device{ window };
-		Renderer renderer{ window, Device };
+		JobSystem Jobs{};
+		FrameResources Frames{ Device, FRAMES_IN_FLIGHT, USE_TIMELINE_SEMAPHORES };
+		Renderer renderer{ window, Device, Frames, USE_DYNAMIC_RENDERING, { PRESENT_POLICY, SWAPCHAIN_IMAGES } };
+		PipelineCompiler Compiler{ Device, 0, USE_GRAPHICS_PIPELINE_LIBRARY };
+		PipelineRegistry Pipelines{ Device, Compiler };
+		GeometryPool Geometry{ Device, Frames, sizeof(Model::Vertex) };
+		FrameAllocator FrameUniforms{ Device, Frames };
 
-		std::unique_ptr<VulkanDescriptorPool> GlobalPool{};
+		VulkanDescriptorAllocator GlobalDescriptors{ Device };
+		std::vector<std::unique_ptr<VulkanDescriptorAllocator>> FrameDescriptors;
 		GameObject::Map GameObjects;
 
 
@@ -0,0 +1,58 @@
+#pragma once
+
+// SPIR-V compiled into the executable. The .inc files are generated before every build by
+// embed_shaders.bat (glslc -mfmt=num), so a shader that fails to compile fails the build.
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace vlkn {
+
+	namespace EmbeddedSpirv {
+		inline constexpr uint32_t ShaderVert[] = {
+#include "shaders/generated/shader.vert.inc"
+		};
+		inline constexpr uint32_t ShaderIndirectVert[] = {
+#include "shaders/generated/shader_indirect.vert.inc"
+		};
+		inline constexpr uint32_t ShaderInstancedVert[] = {
+#include "shaders/generated/shader_instanced.vert.inc"
+		};
+		inline constexpr uint32_t ShaderFrag[] = {
+#include "shaders/generated/shader.frag.inc"
+		};
+	}
+
+	struct EmbeddedShader {
+		// The path the .spv would have on disk, so embedded and file shaders are looked up the same way.
+		std::string_view Path;
+		std::span<const uint32_t> Code;
+	};
+
+	inline constexpr std::array<EmbeddedShader, 4> EMBEDDED_SHADERS{ {
+		{ "shaders/shader.vert.spv", EmbeddedSpirv::ShaderVert },
+		{ "shaders/shader_indirect.vert.spv", EmbeddedSpirv::ShaderIndirectVert },
+		{ "shaders/shader_instanced.vert.spv", EmbeddedSpirv::ShaderInstancedVert },
+		{ "shaders/shader.frag.spv", EmbeddedSpirv::ShaderFrag },
+	} };
+
+	// Empty if the path is not embedded.
+	constexpr std::span<const uint32_t> FindEmbeddedShader(std::string_view path)
+	{
+		for (const auto& Shader : EMBEDDED_SHADERS)
+		{
+			if (Shader.Path == path)
+			{
+				return Shader.Code;
+			}
+		}
+		return {};
+	}
+
+	// SPIR-V starts with the magic number 0x07230203.
+	static_assert(EmbeddedSpirv::ShaderVert[0] == 0x07230203 && EmbeddedSpirv::ShaderFrag[0] == 0x07230203,
+		"Embedded shaders are not SPIR-V");
+	static_assert(!FindEmbeddedShader("shaders/shader.vert.spv").empty());
+}
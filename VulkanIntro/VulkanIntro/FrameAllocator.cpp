@@ -0,0 +1,65 @@
+#include "FrameAllocator.hpp"
+
+#include <stdexcept>
+
+namespace vlkn {
+
+	FrameAllocator::FrameAllocator(VulkanDevice& device, FrameResources& frames, VkDeviceSize frameSize) : Device{device}
+	{
+		Alignment = Device.properties.limits.minUniformBufferOffsetAlignment;
+		FrameSize = VulkanBufferObjects::GetAlignment(frameSize, Alignment);
+		CreateBuffer(frames.GetFramesInFlight());
+		FramesRegistration = frames.Register([this](uint32_t frameCount) { CreateBuffer(frameCount); });
+	}
+
+	void FrameAllocator::CreateBuffer(uint32_t frameCount)
+	{
+		// Each frame region is one "instance" of the buffer, so frame bases stay aligned too.
+		Buffer = std::make_unique<VulkanBufferObjects>(Device, FrameSize, frameCount,
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, Alignment);
+		Buffer->Map();
+		FrameIndex = 0;
+		Head = 0;
+	}
+
+	void FrameAllocator::BeginFrame(int frameIndex)
+	{
+		FrameIndex = frameIndex;
+		Head = 0;
+	}
+
+	/**
+ * Hands out a slice of the current frame's region.
+ *
+ * @param size Size of the slice in bytes
+ *
+ * @return The slice's mapped pointer and the dynamic offset to bind it with. Valid until the same frame
+ * index begins again.
+ */
+	FrameAllocator::Slice FrameAllocator::Allocate(VkDeviceSize size)
+	{
+		VkDeviceSize AlignedSize = VulkanBufferObjects::GetAlignment(size, Alignment);
+		if (Head + AlignedSize > FrameSize)
+		{
+			throw std::runtime_error("Frame Allocator Out of Memory");
+		}
+
+		VkDeviceSize Offset = FrameSize * FrameIndex + Head;
+		Head += AlignedSize;
+
+		Slice NewSlice{};
+		NewSlice.Mapped = static_cast<char*>(Buffer->GetMappedMemory()) + Offset;
+		NewSlice.DynamicOffset = static_cast<uint32_t>(Offset);
+		NewSlice.Size = size;
+		return NewSlice;
+	}
+
+	// Makes everything written this frame visible to the device. A no-op on coherent memory.
+	void FrameAllocator::Flush()
+	{
+		if (Head > 0)
+		{
+			Buffer->Flush(Head, FrameSize * FrameIndex);
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+#include "VulkanBufferObjects.hpp"
+#include "FrameResources.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace vlkn {
+
+	// Bump allocator for per-frame uniform data. One persistently mapped buffer is split into a region per
+	// frame in flight; each region is reset when its frame begins and handed out in slices aligned to
+	// minUniformBufferOffsetAlignment. Slices are bound through VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+	// descriptors that all point at offset 0 of the buffer, so writing new data never touches a descriptor.
+	class FrameAllocator {
+	public:
+		static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 256 * 1024;
+
+		struct Slice {
+			void* Mapped = nullptr;
+			uint32_t DynamicOffset = 0;
+			VkDeviceSize Size = 0;
+		};
+
+		FrameAllocator(VulkanDevice& device, FrameResources& frames, VkDeviceSize frameSize = DEFAULT_FRAME_SIZE);
+
+		FrameAllocator(const FrameAllocator&) = delete;
+		FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+		// Must only be called once the frame's previous submission has completed.
+		void BeginFrame(int frameIndex);
+		Slice Allocate(VkDeviceSize size);
+		void Flush();
+
+		template <typename T>
+		uint32_t Push(const T& value)
+		{
+			Slice NewSlice = Allocate(sizeof(T));
+			*static_cast<T*>(NewSlice.Mapped) = value;
+			return NewSlice.DynamicOffset;
+		}
+
+		// Descriptor for a dynamic uniform binding whose slices are `range` bytes. The buffer is recreated when
+		// the number of frames in flight changes, so descriptors written from this must be rewritten by a
+		// resize callback registered after the allocator.
+		VkDescriptorBufferInfo DescriptorInfo(VkDeviceSize range) { return Buffer->DescriptorInfo(range, 0); }
+
+		VkDeviceSize GetFrameSize() const { return FrameSize; }
+		VkDeviceSize GetBytesUsed() const { return Head; }
+
+	private:
+		void CreateBuffer(uint32_t frameCount);
+
+		VulkanDevice& Device;
+		std::unique_ptr<VulkanBufferObjects> Buffer;
+		VkDeviceSize Alignment;
+		VkDeviceSize FrameSize;
+		int FrameIndex = 0;
+		VkDeviceSize Head = 0;
+		FrameResources::Registration FramesRegistration;
+	};
+}
@@ -2,6 +2,8 @@
 
 #include "Camera.hpp"
 #include "GameObject.hpp"
+#include "GeometryPool.hpp"
+#include "VulkanDescriptors.hpp"
 
 #include <vulkan/vulkan.h>
 
@@ -12,6 +14,13 @@ namespace vlkn {
 		VkCommandBuffer CommandBuffer;
 		Camera& camera;
 		VkDescriptorSet GlobalDescriptorSet;
+		// Dynamic offset of this frame's GlobalUBO slice in the frame allocator.
+		uint32_t GlobalUboOffset;
 		GameObject::Map& GameObjects;
+		GeometryPool& Geometry;
+		// Reset at the start of the frame; for descriptor sets that only live for this frame.
+		VulkanDescriptorAllocator& FrameDescriptors;
+		// Secondary command buffers set their own viewport and scissor from this.
+		VkExtent2D Extent;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "FrameResources.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace vlkn {
+
+	FrameResources::Registration& FrameResources::Registration::operator=(Registration&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			Owner = other.Owner;
+			Id = other.Id;
+			other.Owner = nullptr;
+		}
+		return *this;
+	}
+
+	void FrameResources::Registration::Reset()
+	{
+		if (Owner != nullptr)
+		{
+			Owner->Unregister(Id);
+			Owner = nullptr;
+		}
+	}
+
+	FrameResources::FrameResources(VulkanDevice& device, uint32_t framesInFlight, bool useTimeline)
+		: Device{ device }, FramesInFlight{ Clamp(framesInFlight) }, RequestedFramesInFlight{ FramesInFlight }
+	{
+		if (!useTimeline)
+		{
+			return;
+		}
+		if (!Device.timelineSemaphoreEnabled())
+		{
+			std::cout << "Timeline semaphores not supported on this device, frames are synchronized with fences\n";
+			return;
+		}
+
+		VkSemaphoreTypeCreateInfo TypeInfo{};
+		TypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		TypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		TypeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo SemaphoreInfo{};
+		SemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		SemaphoreInfo.pNext = &TypeInfo;
+
+		if (vkCreateSemaphore(Device.device(), &SemaphoreInfo, nullptr, &Timeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Frame Timeline Semaphore");
+		}
+	}
+
+	FrameResources::~FrameResources()
+	{
+		vkDestroySemaphore(Device.device(), Timeline, nullptr);
+	}
+
+	uint64_t FrameResources::GetCompletedFrame() const
+	{
+		if (UsesTimeline())
+		{
+			uint64_t Value = 0;
+			vkGetSemaphoreCounterValue(Device.device(), Timeline, &Value);
+			return Value;
+		}
+		// The frame slot of the current frame has been waited on, so every frame that used a slot before it has finished.
+		uint64_t Current = GetCurrentFrame();
+		return Current > FramesInFlight ? Current - FramesInFlight : 0;
+	}
+
+	bool FrameResources::WaitForFrame(uint64_t frame, uint64_t timeout) const
+	{
+		assert(UsesTimeline() && "Waiting on a frame needs the frame timeline");
+
+		VkSemaphoreWaitInfo WaitInfo{};
+		WaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		WaitInfo.semaphoreCount = 1;
+		WaitInfo.pSemaphores = &Timeline;
+		WaitInfo.pValues = &frame;
+		VkResult Result = vkWaitSemaphores(Device.device(), &WaitInfo, timeout);
+		if (Result == VK_TIMEOUT)
+		{
+			return false;
+		}
+		if (Result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Wait for Frame Timeline");
+		}
+		return true;
+	}
+
+	FrameResources::Registration FrameResources::Register(ResizeCallback onResize)
+	{
+		uint64_t Id = NextId++;
+		Callbacks.push_back({ Id, std::move(onResize) });
+		return Registration{ this, Id };
+	}
+
+	void FrameResources::RequestFramesInFlight(uint32_t count)
+	{
+		RequestedFramesInFlight = Clamp(count);
+	}
+
+	bool FrameResources::ApplyPendingResize()
+	{
+		if (RequestedFramesInFlight == FramesInFlight)
+		{
+			return false;
+		}
+
+		vkDeviceWaitIdle(Device.device());
+		FramesInFlight = RequestedFramesInFlight;
+		for (auto& Entry : Callbacks)
+		{
+			Entry.OnResize(FramesInFlight);
+		}
+		std::cout << "Frames in flight: " << FramesInFlight << "\n";
+		return true;
+	}
+
+	uint32_t FrameResources::Clamp(uint32_t count)
+	{
+		return std::clamp(count, MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
+	}
+
+	void FrameResources::Unregister(uint64_t id)
+	{
+		std::erase_if(Callbacks, [id](const Callback& Entry) { return Entry.Id == id; });
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace vlkn {
+
+	// Owns the number of frames in flight. Everything that keeps a resource per frame registers a resize
+	// callback here, so the count can change at runtime: fewer frames lower latency, more keep the GPU
+	// busier. A change is applied between frames, with the device idle, by calling every callback in the
+	// order they were registered.
+	//
+	// Also numbers frames, starting at 1, so resources can be reclaimed once the last frame that used them
+	// has completed. With timeline semaphores the swapchain signals each frame's number on one timeline
+	// semaphore, which makes the GPU's progress exact and cheap to query.
+	class FrameResources {
+	public:
+		static constexpr uint32_t MIN_FRAMES_IN_FLIGHT = 1;
+		static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+		static constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+		using ResizeCallback = std::function<void(uint32_t frameCount)>;
+
+		// Unregisters its callback when destroyed.
+		class Registration {
+		public:
+			Registration() = default;
+			~Registration() { Reset(); }
+
+			Registration(Registration&& other) noexcept : Owner{ other.Owner }, Id{ other.Id } { other.Owner = nullptr; }
+			Registration& operator=(Registration&& other) noexcept;
+			Registration(const Registration&) = delete;
+			Registration& operator=(const Registration&) = delete;
+
+			void Reset();
+
+		private:
+			friend class FrameResources;
+			Registration(FrameResources* owner, uint64_t id) : Owner{ owner }, Id{ id } {}
+
+			FrameResources* Owner = nullptr;
+			uint64_t Id = 0;
+		};
+
+		// The count is clamped to [MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT]. Timeline semaphores are only
+		// used if the device supports them; otherwise the swapchain synchronizes with fences.
+		FrameResources(VulkanDevice& device, uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT, bool useTimeline = false);
+		~FrameResources();
+
+		FrameResources(const FrameResources&) = delete;
+		FrameResources& operator=(const FrameResources&) = delete;
+
+		uint32_t GetFramesInFlight() const { return FramesInFlight; }
+
+		bool UsesTimeline() const { return Timeline != VK_NULL_HANDLE; }
+		VkSemaphore GetTimelineSemaphore() const { return Timeline; }
+		// The frame being recorded, or the next one between frames.
+		uint64_t GetCurrentFrame() const { return SubmittedFrame + 1; }
+		// Without a timeline this is derived from the frames in flight, and only exact once the current
+		// frame's wait at the start of the frame has happened.
+		uint64_t GetCompletedFrame() const;
+		bool IsFrameComplete(uint64_t frame) const { return frame <= GetCompletedFrame(); }
+		// Timeline only. Blocks until frame has completed on the GPU, or for at most timeout nanoseconds;
+		// returns whether it completed. May be called from any thread.
+		bool WaitForFrame(uint64_t frame, uint64_t timeout = std::numeric_limits<uint64_t>::max()) const;
+		// Called by the swapchain once the current frame has been submitted.
+		void MarkFrameSubmitted() { SubmittedFrame++; }
+
+		// Resources are created for the current count by their owner; the callback is only called on changes.
+		[[nodiscard]] Registration Register(ResizeCallback onResize);
+
+		// Takes effect at the next ApplyPendingResize.
+		void RequestFramesInFlight(uint32_t count);
+		uint32_t GetRequestedFramesInFlight() const { return RequestedFramesInFlight; }
+		// Call between frames, when nothing is being recorded. Waits for the device to go idle and resizes
+		// every registered resource if the count changed; returns whether it did.
+		bool ApplyPendingResize();
+
+	private:
+		struct Callback {
+			uint64_t Id;
+			ResizeCallback OnResize;
+		};
+
+		static uint32_t Clamp(uint32_t count);
+		void Unregister(uint64_t id);
+
+		VulkanDevice& Device;
+		uint32_t FramesInFlight;
+		uint32_t RequestedFramesInFlight;
+		VkSemaphore Timeline = VK_NULL_HANDLE;
+		uint64_t SubmittedFrame = 0;
+		std::vector<Callback> Callbacks;
+		uint64_t NextId = 1;
+	};
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Model.hpp"
+#include "RenderState.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <memory>
@@ -41,6 +42,8 @@ namespace vlkn {
 		std::shared_ptr<Model> Model{};
 		glm::vec3 Color{};
 		TransformComponent Transform{};
+		// Only honoured when the ShaderSystem renders with dynamic render state.
+		RenderState State{};
 
 	private:
 		GameObject(id_t ObjId):id{ObjId}{}
@@ -0,0 +1,293 @@
+#include "GeometryPool.hpp"
+#include "UploadContext.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace vlkn {
+
+	void GeometryPool::RangeList::Reset(uint32_t capacity, uint32_t used)
+	{
+		FreeRanges.clear();
+		Capacity = capacity;
+		Used = used;
+		if (used < capacity)
+		{
+			FreeRanges[used] = capacity - used;
+		}
+	}
+
+	bool GeometryPool::RangeList::Allocate(uint32_t count, uint32_t& offset)
+	{
+		for (auto it = FreeRanges.begin(); it != FreeRanges.end(); ++it)
+		{
+			if (it->second < count)
+			{
+				continue;
+			}
+
+			offset = it->first;
+			uint32_t Remaining = it->second - count;
+			FreeRanges.erase(it);
+			if (Remaining > 0)
+			{
+				FreeRanges[offset + count] = Remaining;
+			}
+			Used += count;
+			return true;
+		}
+		return false;
+	}
+
+	void GeometryPool::RangeList::Free(uint32_t offset, uint32_t count)
+	{
+		Used -= count;
+		auto Inserted = FreeRanges.emplace(offset, count).first;
+
+		auto Next = std::next(Inserted);
+		if (Next != FreeRanges.end() && Inserted->first + Inserted->second == Next->first)
+		{
+			Inserted->second += Next->second;
+			FreeRanges.erase(Next);
+		}
+
+		if (Inserted != FreeRanges.begin())
+		{
+			auto Prev = std::prev(Inserted);
+			if (Prev->first + Prev->second == Inserted->first)
+			{
+				Prev->second += Inserted->second;
+				FreeRanges.erase(Inserted);
+			}
+		}
+	}
+
+	GeometryPool::GeometryPool(VulkanDevice& device, FrameResources& frames, uint32_t vertexStride, uint32_t vertexCapacity,
+		uint32_t indexCapacity)
+		: Device{device}, Frames{frames}, VertexStride{vertexStride}
+	{
+		CreateBuffers(vertexCapacity, indexCapacity);
+		VertexRanges.Reset(vertexCapacity, 0);
+		IndexRanges.Reset(indexCapacity, 0);
+	}
+
+	GeometryPool::~GeometryPool()
+	{
+		for (auto& Retired : RetiredBuffers)
+		{
+			Device.destroyBuffer(Retired.Buffer, Retired.Memory);
+		}
+		Device.destroyBuffer(VertexBuffer, VertexMemory);
+		Device.destroyBuffer(IndexBuffer, IndexMemory);
+	}
+
+	/**
+ * Reserves vertex and index ranges and records their upload. If the pool is too fragmented or too
+ * small it is compacted (and grown if needed) first.
+ *
+ * @param indices May be null if indexCount is 0, in which case the geometry is drawn non-indexed.
+ *
+ * @return A handle that stays valid until Free() is called, even across compaction.
+ */
+	GeometryPool::Handle GeometryPool::Allocate(const void* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount)
+	{
+		assert(vertexCount > 0 && "Geometry must have vertices");
+
+		Allocation Record{};
+		uint32_t VertexOffset = 0;
+		uint32_t FirstIndex = 0;
+		bool Fits = VertexRanges.Allocate(vertexCount, VertexOffset);
+		if (Fits && indexCount > 0 && !IndexRanges.Allocate(indexCount, FirstIndex))
+		{
+			VertexRanges.Free(VertexOffset, vertexCount);
+			Fits = false;
+		}
+
+		if (!Fits)
+		{
+			// After a rebuild all free space is one range at the end, so sizing for the live data plus this
+			// request is enough for both allocations to succeed.
+			uint32_t VertexCapacity = std::max(VertexRanges.GetCapacity(), 1u);
+			while (VertexCapacity < VertexRanges.GetUsed() + vertexCount) VertexCapacity *= 2;
+			uint32_t IndexCapacity = std::max(IndexRanges.GetCapacity(), 1u);
+			while (IndexCapacity < IndexRanges.GetUsed() + indexCount) IndexCapacity *= 2;
+
+			Rebuild(VertexCapacity, IndexCapacity);
+
+			bool Allocated = VertexRanges.Allocate(vertexCount, VertexOffset);
+			if (indexCount > 0) Allocated = Allocated && IndexRanges.Allocate(indexCount, FirstIndex);
+			if (!Allocated)
+			{
+				throw std::runtime_error("Failed to Allocate Geometry Pool Range");
+			}
+		}
+
+		Record.VertexOffset = static_cast<int32_t>(VertexOffset);
+		Record.VertexCount = vertexCount;
+		Record.FirstIndex = FirstIndex;
+		Record.IndexCount = indexCount;
+
+		UploadContext& Uploads = Device.uploadContext();
+		Uploads.CopyToBuffer(vertices, static_cast<VkDeviceSize>(vertexCount) * VertexStride, VertexBuffer,
+			static_cast<VkDeviceSize>(VertexOffset) * VertexStride);
+		if (indexCount > 0)
+		{
+			Uploads.CopyToBuffer(indices, static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t), IndexBuffer,
+				static_cast<VkDeviceSize>(FirstIndex) * sizeof(uint32_t));
+		}
+
+		Handle NewHandle;
+		if (!FreeHandles.empty())
+		{
+			NewHandle = FreeHandles.back();
+			FreeHandles.pop_back();
+		}
+		else
+		{
+			NewHandle = static_cast<Handle>(Slots.size());
+			Slots.emplace_back();
+		}
+		Slots[NewHandle].Record = Record;
+		Slots[NewHandle].Live = true;
+		return NewHandle;
+	}
+
+	// The ranges are only reused once every frame that may still be drawing from them has retired.
+	void GeometryPool::Free(Handle handle)
+	{
+		assert(handle < Slots.size() && Slots[handle].Live && "Freeing an invalid geometry handle");
+
+		PendingFrees.push_back({ Slots[handle].Record, Frames.GetCurrentFrame() });
+		Slots[handle].Live = false;
+		FreeHandles.push_back(handle);
+	}
+
+	const GeometryPool::Allocation& GeometryPool::Get(Handle handle) const
+	{
+		assert(handle < Slots.size() && Slots[handle].Live && "Invalid geometry handle");
+		return Slots[handle].Record;
+	}
+
+	void GeometryPool::Bind(VkCommandBuffer commandBuffer) const
+	{
+		VkBuffer Buffers[] = { VertexBuffer };
+		VkDeviceSize Offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, Buffers, Offsets);
+		vkCmdBindIndexBuffer(commandBuffer, IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+
+	// Call once per frame, after the frame's fence has been waited on.
+	void GeometryPool::AdvanceFrame()
+	{
+		const uint64_t CompletedFrame = Frames.GetCompletedFrame();
+		auto Expired = [&](uint64_t frame) { return frame <= CompletedFrame; };
+
+		auto FirstPending = std::partition(PendingFrees.begin(), PendingFrees.end(),
+			[&](const PendingFree& pending) { return !Expired(pending.Frame); });
+		for (auto it = FirstPending; it != PendingFrees.end(); ++it)
+		{
+			ReleaseRanges(it->Record);
+		}
+		PendingFrees.erase(FirstPending, PendingFrees.end());
+
+		auto FirstRetired = std::partition(RetiredBuffers.begin(), RetiredBuffers.end(),
+			[&](const RetiredBuffer& retired) { return !Expired(retired.Frame); });
+		for (auto it = FirstRetired; it != RetiredBuffers.end(); ++it)
+		{
+			Device.destroyBuffer(it->Buffer, it->Memory);
+		}
+		RetiredBuffers.erase(FirstRetired, RetiredBuffers.end());
+	}
+
+	// Packs all live geometry to the front of the buffers, merging every freed range into one.
+	void GeometryPool::Compact()
+	{
+		Rebuild(VertexRanges.GetCapacity(), IndexRanges.GetCapacity());
+	}
+
+	GeometryPool::Stats GeometryPool::GetStats() const
+	{
+		Stats PoolStats{};
+		PoolStats.VertexCapacity = VertexRanges.GetCapacity();
+		PoolStats.VerticesInUse = VertexRanges.GetUsed();
+		PoolStats.IndexCapacity = IndexRanges.GetCapacity();
+		PoolStats.IndicesInUse = IndexRanges.GetUsed();
+		PoolStats.AllocationCount = static_cast<uint32_t>(Slots.size() - FreeHandles.size());
+		PoolStats.PendingFreeCount = static_cast<uint32_t>(PendingFrees.size());
+		PoolStats.CompactionCount = CompactionCount;
+		return PoolStats;
+	}
+
+	void GeometryPool::CreateBuffers(uint32_t vertexCapacity, uint32_t indexCapacity)
+	{
+		Device.createBuffer(static_cast<VkDeviceSize>(vertexCapacity) * VertexStride,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VertexBuffer, VertexMemory);
+		Device.createBuffer(static_cast<VkDeviceSize>(indexCapacity) * sizeof(uint32_t),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, IndexBuffer, IndexMemory);
+	}
+
+	/**
+ * Copies every live allocation, tightly packed, into freshly created buffers on the GPU. The old
+ * buffers are kept alive until the frames that may still reference them have retired.
+ *
+ * Ranges waiting in PendingFrees live only in the old buffers, so they are simply dropped.
+ * This blocks until the copy has finished; it only runs when an allocation does not fit or on request.
+ */
+	void GeometryPool::Rebuild(uint32_t vertexCapacity, uint32_t indexCapacity)
+	{
+		VkBuffer OldVertexBuffer = VertexBuffer;
+		VulkanAllocation OldVertexMemory = VertexMemory;
+		VkBuffer OldIndexBuffer = IndexBuffer;
+		VulkanAllocation OldIndexMemory = IndexMemory;
+
+		CreateBuffers(vertexCapacity, indexCapacity);
+
+		std::vector<VkBufferCopy> VertexCopies;
+		std::vector<VkBufferCopy> IndexCopies;
+		uint32_t VertexHead = 0;
+		uint32_t IndexHead = 0;
+		for (auto& Entry : Slots)
+		{
+			if (!Entry.Live) continue;
+
+			Allocation& Record = Entry.Record;
+			VertexCopies.push_back({ static_cast<VkDeviceSize>(Record.VertexOffset) * VertexStride,
+				static_cast<VkDeviceSize>(VertexHead) * VertexStride, static_cast<VkDeviceSize>(Record.VertexCount) * VertexStride });
+			Record.VertexOffset = static_cast<int32_t>(VertexHead);
+			VertexHead += Record.VertexCount;
+
+			if (Record.IndexCount > 0)
+			{
+				IndexCopies.push_back({ static_cast<VkDeviceSize>(Record.FirstIndex) * sizeof(uint32_t),
+					static_cast<VkDeviceSize>(IndexHead) * sizeof(uint32_t), static_cast<VkDeviceSize>(Record.IndexCount) * sizeof(uint32_t) });
+				Record.FirstIndex = IndexHead;
+				IndexHead += Record.IndexCount;
+			}
+		}
+
+		UploadContext& Uploads = Device.uploadContext();
+		Uploads.CopyBuffer(OldVertexBuffer, VertexBuffer, VertexCopies);
+		Uploads.CopyBuffer(OldIndexBuffer, IndexBuffer, IndexCopies);
+		Uploads.Submit().Wait();
+
+		RetiredBuffers.push_back({ OldVertexBuffer, OldVertexMemory, Frames.GetCurrentFrame() });
+		RetiredBuffers.push_back({ OldIndexBuffer, OldIndexMemory, Frames.GetCurrentFrame() });
+		PendingFrees.clear();
+
+		VertexRanges.Reset(vertexCapacity, VertexHead);
+		IndexRanges.Reset(indexCapacity, IndexHead);
+		CompactionCount++;
+	}
+
+	void GeometryPool::ReleaseRanges(const Allocation& record)
+	{
+		VertexRanges.Free(static_cast<uint32_t>(record.VertexOffset), record.VertexCount);
+		if (record.IndexCount > 0)
+		{
+			IndexRanges.Free(record.FirstIndex, record.IndexCount);
+		}
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+#include "FrameResources.hpp"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace vlkn {
+
+	// Sub-allocates vertex and index ranges out of one large device-local vertex buffer and one index
+	// buffer, so every piece of geometry can be drawn after a single bind per frame. Allocations are
+	// referred to by handle; their offsets may change when the pool is compacted or grown, so look them
+	// up with Get() when recording draws.
+	class GeometryPool {
+	public:
+		static constexpr uint32_t DEFAULT_VERTEX_CAPACITY = 256 * 1024;
+		static constexpr uint32_t DEFAULT_INDEX_CAPACITY = 1024 * 1024;
+
+		using Handle = uint32_t;
+		static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+		struct Allocation {
+			int32_t VertexOffset = 0;
+			uint32_t VertexCount = 0;
+			uint32_t FirstIndex = 0;
+			uint32_t IndexCount = 0;
+		};
+
+		struct Stats {
+			uint32_t VertexCapacity = 0;
+			uint32_t VerticesInUse = 0;
+			uint32_t IndexCapacity = 0;
+			uint32_t IndicesInUse = 0;
+			uint32_t AllocationCount = 0;
+			uint32_t PendingFreeCount = 0;
+			uint32_t CompactionCount = 0;
+		};
+
+		// Freed ranges and replaced buffers are kept until frames reports the frame that last used them complete.
+		GeometryPool(VulkanDevice& device, FrameResources& frames, uint32_t vertexStride, uint32_t vertexCapacity = DEFAULT_VERTEX_CAPACITY,
+			uint32_t indexCapacity = DEFAULT_INDEX_CAPACITY);
+		~GeometryPool();
+
+		GeometryPool(const GeometryPool&) = delete;
+		GeometryPool& operator=(const GeometryPool&) = delete;
+
+		// Reserves space and records the copies into the device's upload context. The caller submits.
+		Handle Allocate(const void* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+		void Free(Handle handle);
+		const Allocation& Get(Handle handle) const;
+
+		void Bind(VkCommandBuffer commandBuffer) const;
+		void AdvanceFrame();
+		void Compact();
+
+		uint32_t GetVertexStride() const { return VertexStride; }
+		VulkanDevice& GetDevice() const { return Device; }
+		Stats GetStats() const;
+
+	private:
+		// First-fit allocator over element ranges, keyed by offset with adjacent ranges coalesced.
+		class RangeList {
+		public:
+			void Reset(uint32_t capacity, uint32_t used);
+			bool Allocate(uint32_t count, uint32_t& offset);
+			void Free(uint32_t offset, uint32_t count);
+
+			uint32_t GetCapacity() const { return Capacity; }
+			uint32_t GetUsed() const { return Used; }
+
+		private:
+			std::map<uint32_t, uint32_t> FreeRanges;
+			uint32_t Capacity = 0;
+			uint32_t Used = 0;
+		};
+
+		struct Slot {
+			Allocation Record{};
+			bool Live = false;
+		};
+
+		struct PendingFree {
+			Allocation Record;
+			uint64_t Frame;
+		};
+
+		struct RetiredBuffer {
+			VkBuffer Buffer;
+			VulkanAllocation Memory;
+			uint64_t Frame;
+		};
+
+		void CreateBuffers(uint32_t vertexCapacity, uint32_t indexCapacity);
+		void Rebuild(uint32_t vertexCapacity, uint32_t indexCapacity);
+		void ReleaseRanges(const Allocation& record);
+
+		VulkanDevice& Device;
+		FrameResources& Frames;
+		uint32_t VertexStride;
+
+		VkBuffer VertexBuffer = VK_NULL_HANDLE;
+		VulkanAllocation VertexMemory{};
+		VkBuffer IndexBuffer = VK_NULL_HANDLE;
+		VulkanAllocation IndexMemory{};
+
+		RangeList VertexRanges;
+		RangeList IndexRanges;
+
+		std::vector<Slot> Slots;
+		std::vector<Handle> FreeHandles;
+		std::vector<PendingFree> PendingFrees;
+		std::vector<RetiredBuffer> RetiredBuffers;
+
+		uint32_t CompactionCount = 0;
+	};
+}
@@ -0,0 +1,277 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace vlkn {
+
+	namespace {
+		using Clock = std::chrono::high_resolution_clock;
+
+		// Which system's worker the current thread is, if any.
+		thread_local const JobSystem* CurrentSystem = nullptr;
+		thread_local uint32_t CurrentThread = 0;
+
+		double MsBetween(Clock::time_point From, Clock::time_point To)
+		{
+			return std::chrono::duration<double, std::milli>(To - From).count();
+		}
+	}
+
+	TaskGraph::TaskId TaskGraph::Add(std::string name, std::function<void()> work, std::initializer_list<TaskId> dependencies)
+	{
+		TaskId Id = static_cast<TaskId>(Tasks.size());
+		Task& Added = Tasks.emplace_back();
+		Added.Name = std::move(name);
+		Added.Work = std::move(work);
+		Added.DependencyCount = static_cast<uint32_t>(dependencies.size());
+		for (TaskId Dependency : dependencies)
+		{
+			assert(Dependency < Id && "Tasks can only depend on tasks added before them.");
+			Tasks[Dependency].Successors.push_back(Id);
+		}
+		return Id;
+	}
+
+	std::vector<TaskGraph::TaskTiming> TaskGraph::GetTimings() const
+	{
+		std::vector<TaskTiming> Timings;
+		Timings.reserve(Tasks.size());
+		for (const auto& Entry : Tasks)
+		{
+			Timings.push_back(Entry.Timing);
+		}
+		return Timings;
+	}
+
+	JobSystem::JobSystem(uint32_t workerCount)
+	{
+		if (workerCount == 0)
+		{
+			workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		}
+
+		for (uint32_t i = 0; i <= workerCount; i++)
+		{
+			Queues.push_back(std::make_unique<WorkQueue>());
+		}
+		for (uint32_t i = 1; i <= workerCount; i++)
+		{
+			Workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+		}
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> Lock{ SleepMutex };
+			Stopping = true;
+		}
+		JobAvailable.notify_all();
+		for (auto& Worker : Workers)
+		{
+			Worker.join();
+		}
+	}
+
+	uint32_t JobSystem::GetThreadIndex() const
+	{
+		return CurrentSystem == this ? CurrentThread : 0;
+	}
+
+	void JobSystem::Submit(std::function<void()> job, JobCounter& counter)
+	{
+		counter.Pending.fetch_add(1, std::memory_order_relaxed);
+		Push(Job{ std::move(job), &counter });
+	}
+
+	void JobSystem::Wait(JobCounter& counter)
+	{
+		uint32_t Thread = GetThreadIndex();
+		while (!counter.IsDone())
+		{
+			if (!TryRunOne(Thread))
+			{
+				// The remaining jobs are running on other threads.
+				std::this_thread::yield();
+			}
+		}
+
+		std::lock_guard<std::mutex> Lock{ counter.ErrorMutex };
+		if (counter.Error)
+		{
+			std::exception_ptr Error = counter.Error;
+			counter.Error = nullptr;
+			std::rethrow_exception(Error);
+		}
+	}
+
+	void JobSystem::ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t Begin, size_t End)>& body)
+	{
+		grainSize = std::max<size_t>(grainSize, 1);
+		if (count <= grainSize)
+		{
+			if (count > 0)
+			{
+				body(0, count);
+			}
+			return;
+		}
+
+		JobCounter Counter;
+		for (size_t Begin = grainSize; Begin < count; Begin += grainSize)
+		{
+			Submit([&body, Begin, End = std::min(count, Begin + grainSize)]() { body(Begin, End); }, Counter);
+		}
+		// The first range runs here while the others get picked up.
+		try
+		{
+			body(0, grainSize);
+		}
+		catch (...)
+		{
+			Wait(Counter);
+			throw;
+		}
+		Wait(Counter);
+	}
+
+	void JobSystem::Run(TaskGraph& graph)
+	{
+		graph.RunStart = Clock::now();
+		for (auto& Entry : graph.Tasks)
+		{
+			Entry.Remaining.store(Entry.DependencyCount, std::memory_order_relaxed);
+			Entry.Timing = TaskGraph::TaskTiming{ Entry.Name };
+		}
+
+		JobCounter Done;
+		for (TaskGraph::TaskId Id = 0; Id < graph.Tasks.size(); Id++)
+		{
+			if (graph.Tasks[Id].DependencyCount == 0)
+			{
+				Submit([this, &graph, Id, &Done]() { RunTask(graph, Id, Done); }, Done);
+			}
+		}
+		Wait(Done);
+	}
+
+	// Successors are submitted before this task's job completes, so Done can't reach zero early. A task
+	// that throws never releases its successors.
+	void JobSystem::RunTask(TaskGraph& graph, TaskGraph::TaskId Id, JobCounter& Done)
+	{
+		auto& Entry = graph.Tasks[Id];
+		auto Start = Clock::now();
+		Entry.Work();
+		auto End = Clock::now();
+		Entry.Timing.StartMs = MsBetween(graph.RunStart, Start);
+		Entry.Timing.DurationMs = MsBetween(Start, End);
+		Entry.Timing.Thread = GetThreadIndex();
+
+		for (TaskGraph::TaskId Successor : Entry.Successors)
+		{
+			if (graph.Tasks[Successor].Remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				Submit([this, &graph, Successor, &Done]() { RunTask(graph, Successor, Done); }, Done);
+			}
+		}
+	}
+
+	void JobSystem::Push(Job job)
+	{
+		// Counted first so a thief popping it right away can't take the count below zero.
+		QueuedJobs.fetch_add(1, std::memory_order_release);
+		{
+			auto& Queue = *Queues[GetThreadIndex()];
+			std::lock_guard<std::mutex> Lock{ Queue.Mutex };
+			Queue.Jobs.push_back(std::move(job));
+		}
+
+		// Taking the lock orders this against a worker checking QueuedJobs before it sleeps.
+		{
+			std::lock_guard<std::mutex> Lock{ SleepMutex };
+		}
+		JobAvailable.notify_one();
+	}
+
+	bool JobSystem::TryRunOne(uint32_t Thread)
+	{
+		Job Next;
+		if (!TryPop(Thread, Next))
+		{
+			return false;
+		}
+		Execute(Next);
+		return true;
+	}
+
+	// Newest first from the own deque, which is the work most likely still in cache; oldest first from the
+	// others', which tends to be the largest remaining piece.
+	bool JobSystem::TryPop(uint32_t Thread, Job& job)
+	{
+		{
+			auto& Own = *Queues[Thread];
+			std::lock_guard<std::mutex> Lock{ Own.Mutex };
+			if (!Own.Jobs.empty())
+			{
+				job = std::move(Own.Jobs.back());
+				Own.Jobs.pop_back();
+				QueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		const size_t Count = Queues.size();
+		for (size_t Offset = 1; Offset < Count; Offset++)
+		{
+			auto& Victim = *Queues[(Thread + Offset) % Count];
+			std::lock_guard<std::mutex> Lock{ Victim.Mutex };
+			if (!Victim.Jobs.empty())
+			{
+				job = std::move(Victim.Jobs.front());
+				Victim.Jobs.pop_front();
+				QueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void JobSystem::Execute(Job& job)
+	{
+		try
+		{
+			job.Work();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> Lock{ job.Counter->ErrorMutex };
+			if (!job.Counter->Error)
+			{
+				job.Counter->Error = std::current_exception();
+			}
+		}
+		job.Counter->Pending.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	void JobSystem::WorkerLoop(uint32_t Thread)
+	{
+		CurrentSystem = this;
+		CurrentThread = Thread;
+
+		while (true)
+		{
+			if (TryRunOne(Thread))
+			{
+				continue;
+			}
+
+			std::unique_lock<std::mutex> Lock{ SleepMutex };
+			JobAvailable.wait(Lock, [this]() { return Stopping || QueuedJobs.load(std::memory_order_acquire) > 0; });
+			if (Stopping)
+			{
+				return;
+			}
+		}
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vlkn {
+
+	// Counts the unfinished jobs submitted against it. JobSystem::Wait rethrows the first exception one of
+	// them threw.
+	class JobCounter {
+	public:
+		bool IsDone() const { return Pending.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<uint32_t> Pending{ 0 };
+		std::mutex ErrorMutex;
+		std::exception_ptr Error;
+	};
+
+	// Tasks with dependencies, run by JobSystem::Run. A task only depends on tasks added before it, so the
+	// graph can't have cycles. Build it anew, or Clear it, every time it runs.
+	class TaskGraph {
+	public:
+		using TaskId = uint32_t;
+
+		struct TaskTiming {
+			std::string Name;
+			// Both relative to the start of the last Run.
+			double StartMs = 0.0;
+			double DurationMs = 0.0;
+			uint32_t Thread = 0;
+		};
+
+		TaskId Add(std::string name, std::function<void()> work, std::initializer_list<TaskId> dependencies = {});
+		void Clear() { Tasks.clear(); }
+		size_t GetTaskCount() const { return Tasks.size(); }
+
+		// Only valid once Run has returned.
+		std::vector<TaskTiming> GetTimings() const;
+
+	private:
+		friend class JobSystem;
+
+		struct Task {
+			std::string Name;
+			std::function<void()> Work;
+			std::vector<TaskId> Successors;
+			uint32_t DependencyCount = 0;
+			std::atomic<uint32_t> Remaining{ 0 };
+			TaskTiming Timing;
+		};
+
+		// A deque so tasks never move while their successors are being added.
+		std::deque<Task> Tasks;
+		std::chrono::high_resolution_clock::time_point RunStart;
+	};
+
+	// Work-stealing scheduler. Every worker owns a deque it pushes and pops at the back, and steals from the
+	// front of the others' when its own is empty. Threads that are not workers share one extra deque.
+	// Waiting on a counter runs queued jobs instead of blocking, so jobs may submit and wait on more jobs.
+	class JobSystem {
+	public:
+		// 0 picks one worker per hardware thread, leaving one for the caller.
+		explicit JobSystem(uint32_t workerCount = 0);
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		void Submit(std::function<void()> job, JobCounter& counter);
+		void Wait(JobCounter& counter);
+
+		// Calls body on [Begin, End) ranges of about grainSize items that together cover [0, count), and waits
+		// for all of them.
+		void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t Begin, size_t End)>& body);
+		// Runs every task once its dependencies are done and waits for the whole graph.
+		void Run(TaskGraph& graph);
+
+		// Workers plus the shared slot for other threads.
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(Queues.size()); }
+		// 1 to GetThreadCount() - 1 on this system's workers, 0 on any other thread.
+		uint32_t GetThreadIndex() const;
+
+	private:
+		struct Job {
+			std::function<void()> Work;
+			JobCounter* Counter = nullptr;
+		};
+
+		struct WorkQueue {
+			std::mutex Mutex;
+			std::deque<Job> Jobs;
+		};
+
+		void Push(Job job);
+		bool TryRunOne(uint32_t Thread);
+		bool TryPop(uint32_t Thread, Job& job);
+		void Execute(Job& job);
+		void RunTask(TaskGraph& graph, TaskGraph::TaskId Id, JobCounter& Done);
+		void WorkerLoop(uint32_t Thread);
+
+		std::vector<std::unique_ptr<WorkQueue>> Queues;
+		std::vector<std::thread> Workers;
+		std::atomic<uint32_t> QueuedJobs{ 0 };
+		std::mutex SleepMutex;
+		std::condition_variable JobAvailable;
+		bool Stopping = false;
+	};
+}
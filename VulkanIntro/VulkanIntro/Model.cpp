@@ -26,104 +26,47 @@ namespace std {
 	};
 }
 
-vlkn::Model::Model(VulkanDevice& Device, const Model::ModelData& Data): Device{Device}
+vlkn::Model::Model(GeometryPool& Pool, const Model::ModelData& Data): Model{Pool, Data, DeferredUpload{}}
 {
-	CreateVertexBuffers(Data.vertices);
-	CreateIndexBuffer(Data.indices);
+	Ticket = Pool.GetDevice().uploadContext().Submit();
+}
+
+vlkn::Model::Model(GeometryPool& Pool, const Model::ModelData& Data, DeferredUpload) : Pool{ Pool }, Normals{ Data.hasNormals },
+	VertexColor{ Data.hasVertexColor }
+{
+	assert(Pool.GetVertexStride() == sizeof(Vertex) && "Geometry pool stride does not match Model::Vertex");
+	assert(Data.vertices.size() >= 3 && "Vertex Count must be atleast 3");
+
+	Geometry = Pool.Allocate(Data.vertices.data(), static_cast<uint32_t>(Data.vertices.size()),
+		Data.indices.data(), static_cast<uint32_t>(Data.indices.size()));
 }
 
 vlkn::Model::~Model()
 {
-	
+	// The range must not be handed out again while a copy into it is still pending.
+	Ticket.Wait();
+	Pool.Free(Geometry);
 }
 
-std::unique_ptr<vlkn::Model> vlkn::Model::CreateModelFromObj(VulkanDevice& device, const std::string& filepath)
+std::unique_ptr<vlkn::Model> vlkn::Model::CreateModelFromObj(GeometryPool& Pool, const std::string& filepath)
 {
 	ModelData data{};
 	data.LoadModel(filepath);
 	std::cout << "Vertices Size: " << data.vertices.size() << "\n";
-	return std::make_unique<Model>(device, data);
-}
-
-void vlkn::Model::Bind(VkCommandBuffer CommandBuffer)
-{
-	VkBuffer buffers[] = { VertexBuffer->GetBuffer()};
-	VkDeviceSize offsets[] = { 0 };
-	vkCmdBindVertexBuffers(CommandBuffer, 0, 1, buffers, offsets);
-
-	if (HasIndexBuffer)
-	{
-		vkCmdBindIndexBuffer(CommandBuffer, IndexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
-	}
+	return std::make_unique<Model>(Pool, data);
 }
 
-void vlkn::Model::Draw(VkCommandBuffer CommandBuffer)
+void vlkn::Model::Draw(VkCommandBuffer CommandBuffer, uint32_t InstanceCount, uint32_t FirstInstance)
 {
-	if (HasIndexBuffer) {
-		vkCmdDrawIndexed(CommandBuffer, IndexCount, 1, 0, 0, 0);
+	const auto& Record = Pool.Get(Geometry);
+	if (Record.IndexCount > 0) {
+		vkCmdDrawIndexed(CommandBuffer, Record.IndexCount, InstanceCount, Record.FirstIndex, Record.VertexOffset, FirstInstance);
 	}
 	else {
-		vkCmdDraw(CommandBuffer, VertexCount, 1, 0, 0);
+		vkCmdDraw(CommandBuffer, Record.VertexCount, InstanceCount, static_cast<uint32_t>(Record.VertexOffset), FirstInstance);
 	}
 }
 
-void vlkn::Model::CreateVertexBuffers(const std::vector<Vertex>& vertices)
-{
-	VertexCount = static_cast<uint32_t>(vertices.size());
-	assert(VertexCount >= 3 && "Vertex Count must be atleast 3");
-	VkDeviceSize BufferSize = sizeof(vertices[0]) * VertexCount;
-
-	uint32_t VertexSize = sizeof(vertices[0]);
-
-	
-	VulkanBufferObjects StagingBuffer{
-	Device, VertexSize,  VertexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	};
-
-	StagingBuffer.Map();
-	StagingBuffer.WriteToBuffer((void*)vertices.data());
-	
-	VertexBuffer = std::make_unique<VulkanBufferObjects>(
-		Device, VertexSize, VertexCount,
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-		);
-
-
-	Device.copyBuffer(StagingBuffer.GetBuffer(), VertexBuffer->GetBuffer(), BufferSize);
-}
-
-void vlkn::Model::CreateIndexBuffer(const std::vector<uint32_t>& indices)
-{
-	IndexCount = static_cast<uint32_t>(indices.size());
-	HasIndexBuffer = IndexCount > 0;
-	if (!HasIndexBuffer)
-	{
-		return;
-	}
-	VkDeviceSize BufferSize = sizeof(indices[0]) * IndexCount;
-	uint32_t IndexSize = sizeof(indices[0]);
-
-	VulkanBufferObjects StagingBuffer{
-		Device, IndexSize, IndexCount,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	};
-
-	StagingBuffer.Map();
-	StagingBuffer.WriteToBuffer((void*)indices.data());
-
-	IndexBuffer = std::make_unique<VulkanBufferObjects>(
-		Device, IndexSize, IndexCount,
-		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-	);
-
-
-	Device.copyBuffer(StagingBuffer.GetBuffer(), IndexBuffer->GetBuffer(), BufferSize);
-}
-
 
 std::vector<VkVertexInputBindingDescription> vlkn::Model::Vertex::GetBindingDescriptions()
 {
@@ -159,6 +102,8 @@ void vlkn::Model::ModelData::LoadModel(const std::string& filepath)
 	}
 
 	vertices.clear(); indices.clear();
+	hasNormals = true;
+	hasVertexColor = false;
 
 	std::unordered_map<Vertex, uint32_t> UniqueVertices{};
 
@@ -176,6 +121,10 @@ void vlkn::Model::ModelData::LoadModel(const std::string& filepath)
 				vertex.color = {attrib.colors[3* index.vertex_index + 0],
 								attrib.colors[3* index.vertex_index + 1], 
 								attrib.colors[3* index.vertex_index + 2], };
+				if (vertex.color != glm::vec3{ 1.0f })
+				{
+					hasVertexColor = true;
+				}
 				
 			}
 
@@ -185,6 +134,10 @@ void vlkn::Model::ModelData::LoadModel(const std::string& filepath)
 									attrib.normals[3 * index.normal_index + 1],
 									attrib.normals[3 * index.normal_index + 2] };
 			}
+			else
+			{
+				hasNormals = false;
+			}
 
 			if (index.texcoord_index >= 0)
 			{
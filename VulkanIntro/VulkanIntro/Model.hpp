@@ -1,7 +1,7 @@
 #pragma once
 
-#include "VulkanDevice.hpp"
-#include "VulkanBufferObjects.hpp"
+#include "GeometryPool.hpp"
+#include "UploadContext.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -33,32 +33,43 @@ namespace vlkn {
 		struct ModelData {
 			std::vector<Vertex> vertices{};
 			std::vector<uint32_t> indices{};
+			// False when any vertex of the source mesh came without a normal.
+			bool hasNormals = true;
+			// False when every vertex is white, which is also what the loader fills in for meshes without colors.
+			bool hasVertexColor = true;
 
 			void LoadModel(const std::string& filepath);
 		};
 
-		Model(VulkanDevice& Device, const Model::ModelData &Data);
+		Model(GeometryPool& Pool, const Model::ModelData &Data);
 		~Model();
 
 		Model(const Model&) = delete;
 		Model& operator=(const Model&) = delete;
 
-		static std::unique_ptr<Model> CreateModelFromObj(VulkanDevice& device, const std::string& filepath);
+		static std::unique_ptr<Model> CreateModelFromObj(GeometryPool& Pool, const std::string& filepath);
 
-		void Bind(VkCommandBuffer CommandBuffer);
-		void Draw(VkCommandBuffer CommandBuffer);
-	private:
-		VulkanDevice& Device;
-		std::unique_ptr<VulkanBufferObjects> VertexBuffer;
-		uint32_t VertexCount;
+		// Uploads are asynchronous; the model must not be drawn until they have landed.
+		bool IsReady() const { return Ticket.IsComplete(); }
+
+		const GeometryPool::Allocation& GetGeometry() const { return Pool.Get(Geometry); }
+		bool HasNormals() const { return Normals; }
+		bool HasVertexColor() const { return VertexColor; }
 
-		void CreateVertexBuffers(const std::vector<Vertex> &vertices);
+		// The pool's buffers must already be bound; see GeometryPool::Bind.
+		void Draw(VkCommandBuffer CommandBuffer, uint32_t InstanceCount = 1, uint32_t FirstInstance = 0);
+	private:
+		friend class ModelBatchBuilder;
 
-		bool HasIndexBuffer = false;
-		std::unique_ptr<VulkanBufferObjects> IndexBuffer;
-		uint32_t IndexCount;
+		// Records the copies without submitting; the owner of the batch submits and hands out the ticket.
+		struct DeferredUpload {};
+		Model(GeometryPool& Pool, const Model::ModelData& Data, DeferredUpload);
 
-		void CreateIndexBuffer(const std::vector<uint32_t>& indices);
+		GeometryPool& Pool;
+		GeometryPool::Handle Geometry = GeometryPool::INVALID_HANDLE;
+		UploadTicket Ticket;
+		bool Normals = true;
+		bool VertexColor = true;
 	};
 
 }
\ No newline at end of file
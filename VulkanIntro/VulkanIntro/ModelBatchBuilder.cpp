@@ -0,0 +1,78 @@
+#include "ModelBatchBuilder.hpp"
+
+#include <chrono>
+
+namespace vlkn {
+
+	namespace {
+		using Clock = std::chrono::high_resolution_clock;
+
+		double ElapsedMs(Clock::time_point start)
+		{
+			return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		}
+	}
+
+	ModelBatchBuilder::ModelBatchBuilder(GeometryPool& pool) : Pool{pool}
+	{
+	}
+
+	ModelBatchBuilder& ModelBatchBuilder::Add(Model::ModelData data)
+	{
+		PendingData.push_back(std::move(data));
+		return *this;
+	}
+
+	ModelBatchBuilder& ModelBatchBuilder::AddFromObj(const std::string& filepath)
+	{
+		auto Start = Clock::now();
+		Model::ModelData Data{};
+		Data.LoadModel(filepath);
+		PendingLoadMs += ElapsedMs(Start);
+		return Add(std::move(Data));
+	}
+
+	std::vector<std::shared_ptr<Model>> ModelBatchBuilder::Build(bool waitForUpload)
+	{
+		UploadContext& Uploads = Pool.GetDevice().uploadContext();
+		BatchStats = {};
+		BatchStats.LoadMs = PendingLoadMs;
+		PendingLoadMs = 0.0;
+
+		// Anything already queued by someone else goes out on its own so it is not attributed to this batch.
+		Uploads.Submit();
+		uint64_t FirstSerial = Uploads.GetSubmitCount();
+
+		std::vector<std::shared_ptr<Model>> Models;
+		Models.reserve(PendingData.size());
+
+		auto RecordStart = Clock::now();
+		for (const auto& Data : PendingData)
+		{
+			Models.push_back(std::shared_ptr<Model>(new Model(Pool, Data, Model::DeferredUpload{})));
+			BatchStats.BytesUploaded += sizeof(Model::Vertex) * Data.vertices.size() + sizeof(uint32_t) * Data.indices.size();
+		}
+		BatchStats.RecordMs = ElapsedMs(RecordStart);
+
+		auto SubmitStart = Clock::now();
+		Ticket = Uploads.Submit();
+		BatchStats.SubmitMs = ElapsedMs(SubmitStart);
+
+		for (auto& BatchModel : Models)
+		{
+			BatchModel->Ticket = Ticket;
+		}
+
+		if (waitForUpload)
+		{
+			auto WaitStart = Clock::now();
+			Ticket.Wait();
+			BatchStats.WaitMs = ElapsedMs(WaitStart);
+		}
+
+		BatchStats.ModelCount = Models.size();
+		BatchStats.SubmitCount = Uploads.GetSubmitCount() - FirstSerial;
+		PendingData.clear();
+		return Models;
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Model.hpp"
+#include "UploadContext.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vlkn {
+
+	// Creates many models at once, packing all of their vertex and index copies into a single upload
+	// submission instead of one per model. Every model in a batch shares the batch's UploadTicket.
+	class ModelBatchBuilder {
+	public:
+		struct Stats {
+			size_t ModelCount = 0;
+			VkDeviceSize BytesUploaded = 0;
+			uint64_t SubmitCount = 0;
+			double LoadMs = 0.0;
+			double RecordMs = 0.0;
+			double SubmitMs = 0.0;
+			double WaitMs = 0.0;
+		};
+
+		ModelBatchBuilder(GeometryPool& pool);
+
+		ModelBatchBuilder(const ModelBatchBuilder&) = delete;
+		ModelBatchBuilder& operator=(const ModelBatchBuilder&) = delete;
+
+		ModelBatchBuilder& Add(Model::ModelData data);
+		ModelBatchBuilder& AddFromObj(const std::string& filepath);
+
+		// Returns the models in the order they were added. If waitForUpload is set the call blocks until
+		// the copies have landed, which also records the GPU side of the batch in the stats.
+		std::vector<std::shared_ptr<Model>> Build(bool waitForUpload = false);
+
+		// Describes the last batch built.
+		const Stats& GetStats() const { return BatchStats; }
+		UploadTicket GetTicket() const { return Ticket; }
+
+	private:
+		GeometryPool& Pool;
+		std::vector<Model::ModelData> PendingData;
+		UploadTicket Ticket;
+		Stats BatchStats{};
+		// Time spent loading the pending models, reported with the batch that uploads them.
+		double PendingLoadMs = 0.0;
+	};
+}
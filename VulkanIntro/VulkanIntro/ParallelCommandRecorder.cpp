@@ -0,0 +1,177 @@
+#include "ParallelCommandRecorder.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace vlkn {
+
+	namespace {
+		// Below this a range costs more to hand to another thread than to record.
+		constexpr size_t MIN_ITEMS_PER_RANGE = 256;
+	}
+
+	ParallelCommandRecorder::ParallelCommandRecorder(VulkanDevice& device, JobSystem& jobs, FrameResources& frames, uint32_t maxRanges)
+		: Device{ device }, Jobs{ jobs }, MaxRanges{ maxRanges == 0 ? jobs.GetThreadCount() : maxRanges }
+	{
+		ResizePools(frames.GetFramesInFlight());
+		FramesRegistration = frames.Register([this](uint32_t frameCount) { ResizePools(frameCount); });
+	}
+
+	// Destroying a pool frees its command buffers.
+	ParallelCommandRecorder::~ParallelCommandRecorder()
+	{
+		ResizePools(0);
+	}
+
+	void ParallelCommandRecorder::ResizePools(uint32_t frameCount)
+	{
+		while (Pools.size() > frameCount)
+		{
+			for (auto& ThreadPool : Pools.back())
+			{
+				vkDestroyCommandPool(Device.device(), ThreadPool.Pool, nullptr);
+			}
+			Pools.pop_back();
+		}
+
+		VkCommandPoolCreateInfo PoolInfo{};
+		PoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		PoolInfo.queueFamilyIndex = Device.findPhysicalQueueFamilies().graphicsFamily;
+		// Buffers are only ever reset together with their pool.
+		PoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		while (Pools.size() < frameCount)
+		{
+			auto& FramePools = Pools.emplace_back(Jobs.GetThreadCount());
+			for (auto& ThreadPool : FramePools)
+			{
+				if (vkCreateCommandPool(Device.device(), &PoolInfo, nullptr, &ThreadPool.Pool) != VK_SUCCESS)
+				{
+					throw std::runtime_error("Failed to Create Recording Command Pool");
+				}
+			}
+		}
+		FrameIndex = 0;
+	}
+
+	void ParallelCommandRecorder::BeginFrame(int frameIndex)
+	{
+		FrameIndex = frameIndex;
+		for (auto& ThreadPool : Pools[FrameIndex])
+		{
+			if (ThreadPool.Used > 0)
+			{
+				vkResetCommandPool(Device.device(), ThreadPool.Pool, 0);
+				ThreadPool.Used = 0;
+			}
+		}
+	}
+
+	void ParallelCommandRecorder::Record(VkCommandBuffer Primary, const RenderTargetInfo& Target, VkExtent2D Extent, size_t itemCount,
+		const RangeRecorder& record)
+	{
+		const auto& Secondaries = RecordSecondaries(Target, Extent, itemCount, record);
+		if (!Secondaries.empty())
+		{
+			vkCmdExecuteCommands(Primary, static_cast<uint32_t>(Secondaries.size()), Secondaries.data());
+		}
+	}
+
+	const std::vector<VkCommandBuffer>& ParallelCommandRecorder::RecordSecondaries(const RenderTargetInfo& Target, VkExtent2D Extent,
+		size_t itemCount, const RangeRecorder& record, uint32_t rangeLimit)
+	{
+		uint32_t Limit = rangeLimit == 0 ? MaxRanges : std::min(rangeLimit, MaxRanges);
+		size_t Wanted = (itemCount + MIN_ITEMS_PER_RANGE - 1) / MIN_ITEMS_PER_RANGE;
+		uint32_t RangeCount = static_cast<uint32_t>(std::min<size_t>(Limit, Wanted));
+
+		Current = Pass{ &record, Target, Extent, itemCount, RangeCount };
+		Recorded.assign(RangeCount, VK_NULL_HANDLE);
+		if (RangeCount == 1)
+		{
+			RecordRange(0);
+			return Recorded;
+		}
+
+		JobCounter Counter;
+		for (uint32_t Range = 0; Range < RangeCount; Range++)
+		{
+			Jobs.Submit([this, Range]() { RecordRange(Range); }, Counter);
+		}
+		Jobs.Wait(Counter);
+		return Recorded;
+	}
+
+	// Each job system thread records into its own pool, so no pool is ever used by two threads at once.
+	void ParallelCommandRecorder::RecordRange(uint32_t Range)
+	{
+		uint32_t Thread = Jobs.GetThreadIndex();
+		size_t Begin = Current.ItemCount * Range / Current.RangeCount;
+		size_t End = Current.ItemCount * (Range + 1) / Current.RangeCount;
+
+		VkCommandBuffer CommandBuffer = BeginSecondary(Thread);
+		(*Current.Record)(CommandBuffer, Thread, Begin, End);
+		if (vkEndCommandBuffer(CommandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Record Secondary Command Buffer");
+		}
+		Recorded[Range] = CommandBuffer;
+	}
+
+	VkCommandBuffer ParallelCommandRecorder::BeginSecondary(uint32_t Thread)
+	{
+		ThreadCommandPool& ThreadPool = Pools[FrameIndex][Thread];
+		if (ThreadPool.Used == ThreadPool.Buffers.size())
+		{
+			VkCommandBufferAllocateInfo AllocateInfo{};
+			AllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			AllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			AllocateInfo.commandPool = ThreadPool.Pool;
+			AllocateInfo.commandBufferCount = 1;
+
+			VkCommandBuffer Allocated;
+			if (vkAllocateCommandBuffers(Device.device(), &AllocateInfo, &Allocated) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to allocate Secondary Command Buffer");
+			}
+			ThreadPool.Buffers.push_back(Allocated);
+		}
+		VkCommandBuffer CommandBuffer = ThreadPool.Buffers[ThreadPool.Used++];
+
+		// Only read with dynamic rendering, where there is no render pass to inherit.
+		VkCommandBufferInheritanceRenderingInfo RenderingInfo{};
+		RenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+		RenderingInfo.colorAttachmentCount = 1;
+		RenderingInfo.pColorAttachmentFormats = &Current.Target.ColorFormat;
+		RenderingInfo.depthAttachmentFormat = Current.Target.DepthFormat;
+		RenderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+		RenderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkCommandBufferInheritanceInfo InheritanceInfo{};
+		InheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		InheritanceInfo.pNext = Current.Target.RenderPass == VK_NULL_HANDLE ? &RenderingInfo : nullptr;
+		InheritanceInfo.renderPass = Current.Target.RenderPass;
+		InheritanceInfo.subpass = 0;
+		InheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+		VkCommandBufferBeginInfo BeginInfo{};
+		BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		BeginInfo.pInheritanceInfo = &InheritanceInfo;
+
+		if (vkBeginCommandBuffer(CommandBuffer, &BeginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Begin Recording Secondary Command Buffer");
+		}
+
+		// Secondaries inherit no state from the primary.
+		VkViewport Viewport{};
+		Viewport.width = static_cast<float>(Current.Extent.width);
+		Viewport.height = static_cast<float>(Current.Extent.height);
+		Viewport.minDepth = 0.0f;
+		Viewport.maxDepth = 1.0f;
+		VkRect2D Scissor{ {0, 0}, Current.Extent };
+		vkCmdSetViewport(CommandBuffer, 0, 1, &Viewport);
+		vkCmdSetScissor(CommandBuffer, 0, 1, &Scissor);
+		return CommandBuffer;
+	}
+}
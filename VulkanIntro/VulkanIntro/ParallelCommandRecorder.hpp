@@ -0,0 +1,79 @@
+#pragma once
+
+#include "FrameResources.hpp"
+#include "JobSystem.hpp"
+#include "Pipeline.hpp"
+#include "VulkanDevice.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace vlkn {
+
+	// Records the draws of one pass on the job system's threads. Every thread has its own command pool per
+	// frame in flight, and each contiguous range of the items is recorded into a secondary command buffer that
+	// continues the primary's render pass. The primary executes them in item order, so the result is the same
+	// as recording every item on one thread. Only record from one thread that is not a job system worker at a
+	// time, or from inside a job.
+	class ParallelCommandRecorder {
+	public:
+		// Records items [Begin, End) into CommandBuffer, which already has the viewport and scissor set. Called
+		// concurrently for different ranges; Thread is the job system's index of the calling thread, so
+		// per-thread scratch state can be indexed by it.
+		using RangeRecorder = std::function<void(VkCommandBuffer CommandBuffer, uint32_t Thread, size_t Begin, size_t End)>;
+
+		// Splits a pass into at most maxRanges ranges, 0 for one per job system thread. Keeps one set of pools
+		// per frame in flight and follows frames' resizes.
+		ParallelCommandRecorder(VulkanDevice& device, JobSystem& jobs, FrameResources& frames, uint32_t maxRanges = 0);
+		~ParallelCommandRecorder();
+
+		ParallelCommandRecorder(const ParallelCommandRecorder&) = delete;
+		ParallelCommandRecorder& operator=(const ParallelCommandRecorder&) = delete;
+
+		// Call once the frame's fence has been waited on; recycles the command buffers it recorded last time.
+		void BeginFrame(int frameIndex);
+
+		// Primary must have begun the render pass, or dynamic rendering, with secondary command buffer contents.
+		void Record(VkCommandBuffer Primary, const RenderTargetInfo& Target, VkExtent2D Extent, size_t itemCount,
+			const RangeRecorder& record);
+		// Records the secondaries without executing them, in at most rangeLimit ranges (0 for the recorder's
+		// limit). The returned buffers stay valid until the next BeginFrame for this frame.
+		const std::vector<VkCommandBuffer>& RecordSecondaries(const RenderTargetInfo& Target, VkExtent2D Extent, size_t itemCount,
+			const RangeRecorder& record, uint32_t rangeLimit = 0);
+
+		uint32_t GetThreadCount() const { return Jobs.GetThreadCount(); }
+		uint32_t GetMaxRanges() const { return MaxRanges; }
+
+	private:
+		struct ThreadCommandPool {
+			VkCommandPool Pool = VK_NULL_HANDLE;
+			// Allocated on demand and reused after every reset.
+			std::vector<VkCommandBuffer> Buffers;
+			size_t Used = 0;
+		};
+
+		struct Pass {
+			const RangeRecorder* Record = nullptr;
+			RenderTargetInfo Target{};
+			VkExtent2D Extent{};
+			size_t ItemCount = 0;
+			uint32_t RangeCount = 0;
+		};
+
+		void ResizePools(uint32_t frameCount);
+		void RecordRange(uint32_t Range);
+		VkCommandBuffer BeginSecondary(uint32_t Thread);
+
+		VulkanDevice& Device;
+		JobSystem& Jobs;
+		uint32_t MaxRanges;
+		int FrameIndex = 0;
+		// Indexed by frame, then by job system thread; a thread records its ranges one after another.
+		std::vector<std::vector<ThreadCommandPool>> Pools;
+
+		Pass Current{};
+		std::vector<VkCommandBuffer> Recorded;
+		FrameResources::Registration FramesRegistration;
+	};
+}
@@ -1,27 +1,135 @@
 #include "Pipeline.hpp"
+#include "PipelineLibraryCache.hpp"
 #include "Model.hpp"
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
 #include <iostream>
+#include <sstream>
+
+void vlkn::SpecializationConstants::SetBits(uint32_t constantId, uint32_t bits)
+{
+	for (size_t i = 0; i < Entries.size(); i++)
+	{
+		if (Entries[i].constantID == constantId)
+		{
+			Data[i] = bits;
+			return;
+		}
+	}
+
+	Entries.push_back({ constantId, static_cast<uint32_t>(Data.size() * sizeof(uint32_t)), sizeof(uint32_t) });
+	Data.push_back(bits);
+}
+
+VkSpecializationInfo vlkn::SpecializationConstants::GetInfo() const
+{
+	VkSpecializationInfo Info{};
+	Info.mapEntryCount = static_cast<uint32_t>(Entries.size());
+	Info.pMapEntries = Entries.data();
+	Info.dataSize = Data.size() * sizeof(uint32_t);
+	Info.pData = Data.data();
+	return Info;
+}
+
+VkPipelineRenderingCreateInfo vlkn::PipelineConfigInfo::GetRenderingCreateInfo() const
+{
+	VkPipelineRenderingCreateInfo RenderingInfo{};
+	RenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	RenderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorAttachmentFormats.size());
+	RenderingInfo.pColorAttachmentFormats = colorAttachmentFormats.data();
+	RenderingInfo.depthAttachmentFormat = depthAttachmentFormat;
+	RenderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+	return RenderingInfo;
+}
+
+bool vlkn::PipelineConfigInfo::IsDynamic(VkDynamicState State) const
+{
+	return std::find(DynamicStateEnables.begin(), DynamicStateEnables.end(), State) != DynamicStateEnables.end();
+}
+
+void vlkn::RenderTargetInfo::Apply(PipelineConfigInfo& ConfigInfo) const
+{
+	ConfigInfo.renderPass = RenderPass;
+	ConfigInfo.subpass = 0;
+	ConfigInfo.colorAttachmentFormats.clear();
+	ConfigInfo.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+	if (RenderPass == VK_NULL_HANDLE)
+	{
+		ConfigInfo.colorAttachmentFormats.push_back(ColorFormat);
+		ConfigInfo.depthAttachmentFormat = DepthFormat;
+	}
+}
 
 vlkn::Pipeline::Pipeline(VulkanDevice& Device, const std::string& VertFilePath, const std::string& FragFilePath, const PipelineConfigInfo& ConfigInfo) :
  Device{ Device }
 {
-	CreateGraphicsPipeline(VertFilePath, FragFilePath, ConfigInfo);
+	VertShader = Device.shaderModuleCache().Load(VertFilePath);
+	FragShader = Device.shaderModuleCache().Load(FragFilePath);
+	CreateGraphicsPipeline(VertFilePath, ConfigInfo);
+}
+
+vlkn::Pipeline::Pipeline(VulkanDevice& Device, std::shared_ptr<const ShaderModuleCache::Module> VertModule,
+	std::shared_ptr<const ShaderModuleCache::Module> FragModule, const PipelineConfigInfo& ConfigInfo, const std::string& Name) :
+	Device{ Device }, VertShader{ std::move(VertModule) }, FragShader{ std::move(FragModule) }
+{
+	CreateGraphicsPipeline(Name, ConfigInfo);
 }
 
+vlkn::Pipeline::Pipeline(VulkanDevice& Device, PipelineLibraryCache& Libraries, std::shared_ptr<const ShaderModuleCache::Module> VertModule,
+	std::shared_ptr<const ShaderModuleCache::Module> FragModule, const PipelineConfigInfo& ConfigInfo, const std::string& Name) :
+	Device{ Device }, VertShader{ std::move(VertModule) }, FragShader{ std::move(FragModule) }
+{
+	auto Start = std::chrono::high_resolution_clock::now();
+	LibraryParts = Libraries.GetLibraries(ConfigInfo, *VertShader, *FragShader);
+	auto Linking = std::chrono::high_resolution_clock::now();
+	GraphicsPipeline = Libraries.FastLink(LibraryParts, ConfigInfo.pipelineLayout);
+	auto End = std::chrono::high_resolution_clock::now();
+
+	Link = std::make_shared<OptimizedLink>();
+	Link->Current.store(GraphicsPipeline);
+	Libraries.LinkOptimizedAsync(LibraryParts, ConfigInfo.pipelineLayout, Name,
+		[State = Link, LogicalDevice = Device.device()](VkPipeline Optimized) {
+			std::lock_guard<std::mutex> Lock{ State->Mutex };
+			if (State->Released)
+			{
+				vkDestroyPipeline(LogicalDevice, Optimized, nullptr);
+				return;
+			}
+			State->Optimized = Optimized;
+			State->Current.store(Optimized, std::memory_order_release);
+		});
+
+	std::ostringstream Log;
+	Log << "Pipeline " << Name << " fast-linked in " << std::chrono::duration<float, std::milli>(End - Linking).count()
+		<< " ms after " << std::chrono::duration<float, std::milli>(Linking - Start).count() << " ms of library compiles\n";
+	std::cout << Log.str();
+}
 
 vlkn::Pipeline::~Pipeline()
 {
-	vkDestroyShaderModule(Device.device(), VertShaderModule, nullptr);
-	vkDestroyShaderModule(Device.device(), FragShaderModule, nullptr);
+	if (Link)
+	{
+		std::lock_guard<std::mutex> Lock{ Link->Mutex };
+		Link->Released = true;
+		if (Link->Optimized != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(Device.device(), Link->Optimized, nullptr);
+		}
+	}
 	vkDestroyPipeline(Device.device(), GraphicsPipeline, nullptr);
 }
 
 void vlkn::Pipeline::bind(VkCommandBuffer CommandBuffer)
 {
-	vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GraphicsPipeline);
+	VkPipeline Handle = Link ? Link->Current.load(std::memory_order_acquire) : GraphicsPipeline;
+	vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Handle);
+}
+
+bool vlkn::Pipeline::IsOptimized() const
+{
+	return !Link || Link->Current.load(std::memory_order_acquire) != GraphicsPipeline;
 }
 
 void vlkn::Pipeline::DefaultPipelineConfigInfo(
@@ -99,56 +207,55 @@ void vlkn::Pipeline::DefaultPipelineConfigInfo(
 		static_cast<uint32_t>(ConfigInfo.DynamicStateEnables.size());
 	ConfigInfo.DynamicStateInfo.flags = 0;
 
+	ConfigInfo.bindingDescriptions = Model::Vertex::GetBindingDescriptions();
+	ConfigInfo.attributeDescriptions = Model::Vertex::GetAtributeDescriptions();
 }
 
-std::vector<char> vlkn::Pipeline::ReadFile(const std::string& FilePath)
+void vlkn::Pipeline::EnableDynamicRenderState(PipelineConfigInfo& ConfigInfo, bool dynamicPolygonMode)
 {
-	std::ifstream file{ FilePath, std::ios::ate | std::ios::binary };
-
-	if (!file.is_open())
+	// Core since 1.3 (extended dynamic state 1 and 2).
+	std::vector<VkDynamicState> States = {
+		VK_DYNAMIC_STATE_CULL_MODE, VK_DYNAMIC_STATE_FRONT_FACE, VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY,
+		VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE, VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE, VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+		VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE };
+	if (dynamicPolygonMode)
 	{
-		throw std::runtime_error("Failed to Open File: " + FilePath);
+		States.push_back(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
 	}
 
-	size_t FileSize = static_cast<size_t>(file.tellg());
-
-
-	std::vector<char> buffer(FileSize);
-
-	file.seekg(0);
-	file.read(buffer.data(), FileSize);
-
-	file.close();
-	return buffer;
+	for (VkDynamicState State : States)
+	{
+		if (!ConfigInfo.IsDynamic(State))
+		{
+			ConfigInfo.DynamicStateEnables.push_back(State);
+		}
+	}
+	ConfigInfo.DynamicStateInfo.pDynamicStates = ConfigInfo.DynamicStateEnables.data();
+	ConfigInfo.DynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(ConfigInfo.DynamicStateEnables.size());
 }
 
-void vlkn::Pipeline::CreateGraphicsPipeline(const std::string& VertFilePath, const std::string& FragFilePath, const PipelineConfigInfo& ConfigInfo)
+void vlkn::Pipeline::CreateGraphicsPipeline(const std::string& Name, const PipelineConfigInfo& ConfigInfo)
 {
-	auto VertCode = ReadFile(VertFilePath);
-	auto FragCode = ReadFile(FragFilePath);
-
-	CreateShaderModule(VertCode, &VertShaderModule);
-	CreateShaderModule(FragCode, &FragShaderModule);
+	VkSpecializationInfo SpecializationInfo = ConfigInfo.specialization.GetInfo();
+	const VkSpecializationInfo* pSpecializationInfo = ConfigInfo.specialization.IsEmpty() ? nullptr : &SpecializationInfo;
 
 	VkPipelineShaderStageCreateInfo ShaderStages[2];
 	ShaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	ShaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-	ShaderStages[0].module = VertShaderModule;
 	ShaderStages[0].pName = "main";
 	ShaderStages[0].flags = 0;
-	ShaderStages[0].pNext = nullptr;
-	ShaderStages[0].pSpecializationInfo = nullptr;
+	VertShader->FillStage(ShaderStages[0]);
+	ShaderStages[0].pSpecializationInfo = pSpecializationInfo;
 
 	ShaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	ShaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	ShaderStages[1].module = FragShaderModule;
 	ShaderStages[1].pName = "main";
 	ShaderStages[1].flags = 0;
-	ShaderStages[1].pNext = nullptr;
-	ShaderStages[1].pSpecializationInfo = nullptr;
+	FragShader->FillStage(ShaderStages[1]);
+	ShaderStages[1].pSpecializationInfo = pSpecializationInfo;
 
-	auto BindingDescriptions = Model::Vertex::GetBindingDescriptions();
-	auto AttrDescriptions = Model::Vertex::GetAtributeDescriptions();
+	auto& BindingDescriptions = ConfigInfo.bindingDescriptions;
+	auto& AttrDescriptions = ConfigInfo.attributeDescriptions;
 
 	VkPipelineVertexInputStateCreateInfo VertexInputInfo{};
 	VertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -157,8 +264,11 @@ void vlkn::Pipeline::CreateGraphicsPipeline(const std::string& VertFilePath, con
 	VertexInputInfo.pVertexAttributeDescriptions = AttrDescriptions.data();
 	VertexInputInfo.pVertexBindingDescriptions = BindingDescriptions.data();
 
+	VkPipelineRenderingCreateInfo RenderingInfo = ConfigInfo.GetRenderingCreateInfo();
+
 	VkGraphicsPipelineCreateInfo PipelineInfo{};
 	PipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	PipelineInfo.pNext = ConfigInfo.renderPass == VK_NULL_HANDLE ? &RenderingInfo : nullptr;
 	PipelineInfo.stageCount = 2;
 	PipelineInfo.pStages = ShaderStages;
 	PipelineInfo.pVertexInputState = &VertexInputInfo;
@@ -179,25 +289,25 @@ void vlkn::Pipeline::CreateGraphicsPipeline(const std::string& VertFilePath, con
 	PipelineInfo.basePipelineIndex = -1;
 
 
-	if (vkCreateGraphicsPipelines(Device.device(), VK_NULL_HANDLE, 1, &PipelineInfo, nullptr, &GraphicsPipeline) != VK_SUCCESS)
+	VkPipelineCache Cache = ConfigInfo.pipelineCache != VK_NULL_HANDLE ? ConfigInfo.pipelineCache : Device.pipelineCache();
+
+	auto Start = std::chrono::high_resolution_clock::now();
+	if (vkCreateGraphicsPipelines(Device.device(), Cache, 1, &PipelineInfo, nullptr, &GraphicsPipeline) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to Create Graphics Pipeline");
 	}
-
-}
-
-void vlkn::Pipeline::CreateShaderModule(const std::vector<char>& code, VkShaderModule* ShaderModule)
-{
-	VkShaderModuleCreateInfo CreateInfo{};
-	CreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	CreateInfo.codeSize = code.size();
-	CreateInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-	if (vkCreateShaderModule(Device.device(), &CreateInfo, nullptr, ShaderModule) != VK_SUCCESS)
+	float Ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - Start).count();
+	// Pipelines may be built on worker threads, so the line is written in one go.
+	std::ostringstream Log;
+	Log << "Pipeline " << Name << " created in " << Ms << " ms (";
+	if (ConfigInfo.pipelineCache != VK_NULL_HANDLE)
 	{
-		throw std::runtime_error("Failed to Create Shader Module");
+		Log << "private cache)\n";
 	}
-
+	else
+	{
+		Log << (Device.pipelineCacheWarm() ? "warm" : "cold") << " cache)\n";
+	}
+	std::cout << Log.str();
 
 }
-
@@ -1,15 +1,63 @@
 #pragma once
 
 #include "VulkanDevice.hpp"
+#include "ShaderModuleCache.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
+#include <type_traits>
 #include <vector>
 namespace vlkn
 {
+	class PipelineLibrary;
+	class PipelineLibraryCache;
+
+	// Typed specialization constants shared by every stage of a pipeline. Stages ignore ids they do not declare.
+	class SpecializationConstants {
+	public:
+		template <typename T>
+		void Set(uint32_t constantId, T value)
+		{
+			static_assert(std::is_same_v<T, bool> || std::is_same_v<T, int32_t> || std::is_same_v<T, uint32_t> ||
+				std::is_same_v<T, float>, "Specialization constants must be bool, int32_t, uint32_t or float");
+
+			uint32_t Bits;
+			if constexpr (std::is_same_v<T, bool>)
+			{
+				Bits = value ? VK_TRUE : VK_FALSE;
+			}
+			else
+			{
+				static_assert(sizeof(T) == sizeof(uint32_t));
+				memcpy(&Bits, &value, sizeof(Bits));
+			}
+			SetBits(constantId, Bits);
+		}
+
+		bool IsEmpty() const { return Entries.empty(); }
+
+		// The returned info points into this object and is only valid while it is unchanged.
+		VkSpecializationInfo GetInfo() const;
+
+	private:
+		void SetBits(uint32_t constantId, uint32_t bits);
+
+		std::vector<VkSpecializationMapEntry> Entries;
+		std::vector<uint32_t> Data;
+	};
+
 	struct PipelineConfigInfo {
 		PipelineConfigInfo(const PipelineConfigInfo&) = delete;
 		PipelineConfigInfo& operator=(const PipelineConfigInfo&) = delete;
 		PipelineConfigInfo() = default;
 
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
 		VkPipelineViewportStateCreateInfo viewportInfo;
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
 		VkPipelineRasterizationStateCreateInfo rasterizationInfo;
@@ -20,12 +68,40 @@ namespace vlkn
 		std::vector<VkDynamicState> DynamicStateEnables;
 		VkPipelineDynamicStateCreateInfo DynamicStateInfo;
 		VkPipelineLayout pipelineLayout = nullptr;
+		// Leave renderPass null to build for dynamic rendering against the attachment formats instead.
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
+		std::vector<VkFormat> colorAttachmentFormats{};
+		VkFormat depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+		SpecializationConstants specialization{};
+		// VK_NULL_HANDLE uses the device's persistent pipeline cache.
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+		// For pipelines without a render pass; points into this config.
+		VkPipelineRenderingCreateInfo GetRenderingCreateInfo() const;
+		bool IsDynamic(VkDynamicState State) const;
+	};
+
+	// What pipelines render into: a render pass, or with dynamic rendering only the attachment formats.
+	struct RenderTargetInfo {
+		VkRenderPass RenderPass = VK_NULL_HANDLE;
+		VkFormat ColorFormat = VK_FORMAT_UNDEFINED;
+		VkFormat DepthFormat = VK_FORMAT_UNDEFINED;
+
+		void Apply(PipelineConfigInfo& ConfigInfo) const;
 	};
+
 	class Pipeline {
 	public:
 		Pipeline(VulkanDevice &Device, const std::string& VertFilePath, const std::string& FragFilePath, const PipelineConfigInfo& ConfigInfo);
+		// Builds from modules already in the shader module cache; no file I/O.
+		Pipeline(VulkanDevice& Device, std::shared_ptr<const ShaderModuleCache::Module> VertModule,
+			std::shared_ptr<const ShaderModuleCache::Module> FragModule, const PipelineConfigInfo& ConfigInfo, const std::string& Name);
+
+		// Fast-links ConfigInfo from graphics pipeline libraries, then swaps in a link-time optimized pipeline
+		// once Libraries has linked it in the background. Binding is valid throughout.
+		Pipeline(VulkanDevice& Device, PipelineLibraryCache& Libraries, std::shared_ptr<const ShaderModuleCache::Module> VertModule,
+			std::shared_ptr<const ShaderModuleCache::Module> FragModule, const PipelineConfigInfo& ConfigInfo, const std::string& Name);
 
 		~Pipeline();
 
@@ -33,16 +109,31 @@ namespace vlkn
 		Pipeline& operator=(const Pipeline&) = delete;
 
 		void bind(VkCommandBuffer CommandBuffer);
+		// False only while a fast-linked pipeline is waiting for its optimized link.
+		bool IsOptimized() const;
 		static void DefaultPipelineConfigInfo(PipelineConfigInfo& ConfigInfo);
+		// Makes the state in RenderState dynamic; the values baked into ConfigInfo are then ignored and left out
+		// of its pipeline's identity. Polygon mode only with dynamicPolygonMode.
+		static void EnableDynamicRenderState(PipelineConfigInfo& ConfigInfo, bool dynamicPolygonMode);
 	private:
-		static std::vector<char> ReadFile(const std::string& FilePath);
-		void CreateGraphicsPipeline(const std::string& VertFilePath, const std::string& FragFilePath, const PipelineConfigInfo& ConfigInfo);
+		void CreateGraphicsPipeline(const std::string& Name, const PipelineConfigInfo& ConfigInfo);
 
-		void CreateShaderModule(const std::vector<char>& code, VkShaderModule * ShaderModule);
+		// Shared with the background link, which may finish after the Pipeline is gone.
+		struct OptimizedLink {
+			std::atomic<VkPipeline> Current;
+			std::mutex Mutex;
+			VkPipeline Optimized = VK_NULL_HANDLE;
+			bool Released = false;
+		};
 
 		VulkanDevice& Device;
+		// The monolithic or fast-linked pipeline. A fast-linked one is kept until destruction, as command
+		// buffers recorded before the optimized pipeline arrived may still reference it.
 		VkPipeline GraphicsPipeline;
-		VkShaderModule VertShaderModule;
-		VkShaderModule FragShaderModule;
+		std::shared_ptr<OptimizedLink> Link;
+		std::array<std::shared_ptr<const PipelineLibrary>, 4> LibraryParts;
+		// Shared with every other pipeline built from the same SPIR-V.
+		std::shared_ptr<const ShaderModuleCache::Module> VertShader;
+		std::shared_ptr<const ShaderModuleCache::Module> FragShader;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "PipelineCompiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+namespace vlkn {
+
+	std::shared_ptr<const ShaderModuleCache::Module> PipelineCompiler::Request::LoadVertShader(ShaderModuleCache& Shaders) const
+	{
+		return VertCode.empty() ? Shaders.Load(VertFilePath) : Shaders.Load(VertCode);
+	}
+
+	std::shared_ptr<const ShaderModuleCache::Module> PipelineCompiler::Request::LoadFragShader(ShaderModuleCache& Shaders) const
+	{
+		return FragCode.empty() ? Shaders.Load(FragFilePath) : Shaders.Load(FragCode);
+	}
+
+	PipelineCompiler::PipelineCompiler(VulkanDevice& device, uint32_t threadCount, bool useLibraries) : Device{device}
+	{
+		if (useLibraries && Device.isExtensionEnabled(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+		{
+			Libraries = std::make_unique<PipelineLibraryCache>(Device, [this](std::function<void()> job) { Enqueue(std::move(job)); });
+		}
+
+		if (threadCount == 0)
+		{
+			// hardware_concurrency may be 0 when unknown; the compiler always needs at least one thread.
+			threadCount = std::max(1u, std::max(1u, std::thread::hardware_concurrency()) - 1);
+		}
+
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			Workers.emplace_back(&PipelineCompiler::WorkerLoop, this);
+		}
+	}
+
+	PipelineCompiler::~PipelineCompiler()
+	{
+		{
+			std::lock_guard<std::mutex> Lock{ Mutex };
+			Stopping = true;
+		}
+		JobAvailable.notify_all();
+		for (auto& Worker : Workers)
+		{
+			Worker.join();
+		}
+	}
+
+	// Build errors are rethrown from the returned future's get().
+	std::future<std::unique_ptr<Pipeline>> PipelineCompiler::Compile(Request request)
+	{
+		auto Task = std::make_shared<std::packaged_task<std::unique_ptr<Pipeline>()>>(
+			[this, Req = std::move(request)]() {
+				return Build(Req);
+			});
+		auto Result = Task->get_future();
+		Enqueue([Task]() { (*Task)(); });
+		return Result;
+	}
+
+	std::shared_future<std::shared_ptr<Pipeline>> PipelineCompiler::CompileShared(Request request)
+	{
+		auto Task = std::make_shared<std::packaged_task<std::shared_ptr<Pipeline>()>>(
+			[this, Req = std::move(request)]() {
+				return std::shared_ptr<Pipeline>(Build(Req));
+			});
+		auto Result = Task->get_future().share();
+		Enqueue([Task]() { (*Task)(); });
+		return Result;
+	}
+
+	std::unique_ptr<Pipeline> PipelineCompiler::Build(const Request& request)
+	{
+		// Requests with a private cache come from the benchmark, which measures full compiles.
+		if (Libraries && request.Config->pipelineCache == VK_NULL_HANDLE)
+		{
+			auto& Shaders = Device.shaderModuleCache();
+			auto VertShader = request.LoadVertShader(Shaders);
+			auto FragShader = request.LoadFragShader(Shaders);
+			try
+			{
+				return std::make_unique<Pipeline>(Device, *Libraries, std::move(VertShader), std::move(FragShader), *request.Config,
+					request.VertFilePath);
+			}
+			catch (const std::exception& e)
+			{
+				std::cout << "Linking pipeline " + request.VertFilePath + " from libraries failed, compiling it whole: " + e.what() + "\n";
+			}
+		}
+		return BuildMonolithic(request);
+	}
+
+	std::unique_ptr<Pipeline> PipelineCompiler::BuildMonolithic(const Request& request)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		auto& Shaders = Device.shaderModuleCache();
+		auto Built = std::make_unique<Pipeline>(Device, request.LoadVertShader(Shaders), request.LoadFragShader(Shaders), *request.Config,
+			request.VertFilePath);
+		double Ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+
+		std::lock_guard<std::mutex> Lock{ TimingsMutex };
+		CompileTimings.MonolithicPipelines++;
+		CompileTimings.MonolithicMs += Ms;
+		return Built;
+	}
+
+	PipelineCompiler::Timings PipelineCompiler::GetTimings() const
+	{
+		Timings Result;
+		{
+			std::lock_guard<std::mutex> Lock{ TimingsMutex };
+			Result = CompileTimings;
+		}
+		if (Libraries)
+		{
+			Result.Libraries = Libraries->GetStats();
+		}
+		return Result;
+	}
+
+	void PipelineCompiler::Enqueue(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> Lock{ Mutex };
+			Jobs.push(std::move(job));
+		}
+		JobAvailable.notify_one();
+	}
+
+	std::vector<std::unique_ptr<Pipeline>> PipelineCompiler::CompileAll(std::vector<Request> requests)
+	{
+		std::vector<std::future<std::unique_ptr<Pipeline>>> Futures;
+		for (auto& Req : requests)
+		{
+			Futures.push_back(Compile(std::move(Req)));
+		}
+
+		std::vector<std::unique_ptr<Pipeline>> Pipelines;
+		for (auto& Future : Futures)
+		{
+			Pipelines.push_back(Future.get());
+		}
+		return Pipelines;
+	}
+
+	PipelineCompiler::BenchmarkResult PipelineCompiler::Benchmark(const std::function<std::vector<Request>()>& makeRequests)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+
+		auto RunWithFreshCache = [&](bool parallel) {
+			VkPipelineCacheCreateInfo CacheInfo{};
+			CacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			VkPipelineCache Cache;
+			if (vkCreatePipelineCache(Device.device(), &CacheInfo, nullptr, &Cache) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to Create Benchmark Pipeline Cache");
+			}
+
+			auto Requests = makeRequests();
+			for (auto& Req : Requests)
+			{
+				Req.Config->pipelineCache = Cache;
+			}
+
+			auto Start = Clock::now();
+			std::vector<std::unique_ptr<Pipeline>> Pipelines;
+			if (parallel)
+			{
+				Pipelines = CompileAll(std::move(Requests));
+			}
+			else
+			{
+				for (auto& Req : Requests)
+				{
+					Pipelines.push_back(Build(Req));
+				}
+			}
+			double Ms = std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+
+			Pipelines.clear();
+			vkDestroyPipelineCache(Device.device(), Cache, nullptr);
+			return std::make_pair(Ms, Requests.size());
+		};
+
+		BenchmarkResult Result{};
+		Result.ThreadCount = GetThreadCount();
+		auto Serial = RunWithFreshCache(false);
+		Result.SerialMs = Serial.first;
+		Result.PipelineCount = Serial.second;
+		Result.ParallelMs = RunWithFreshCache(true).first;
+		return Result;
+	}
+
+	void PipelineCompiler::WorkerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> Job;
+			{
+				std::unique_lock<std::mutex> Lock{ Mutex };
+				JobAvailable.wait(Lock, [this]() { return Stopping || !Jobs.empty(); });
+				if (Stopping && Jobs.empty())
+				{
+					return;
+				}
+				Job = std::move(Jobs.front());
+				Jobs.pop();
+			}
+			Job();
+		}
+	}
+}
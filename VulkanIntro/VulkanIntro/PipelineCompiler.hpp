@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Pipeline.hpp"
+#include "PipelineLibraryCache.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vlkn {
+
+	// Builds pipelines on a pool of worker threads. vkCreateGraphicsPipelines may be called concurrently,
+	// and the device's pipeline cache is internally synchronized, so requests are fully independent.
+	class PipelineCompiler {
+	public:
+		struct Request {
+			std::string VertFilePath;
+			std::string FragFilePath;
+			// Heap allocated because the config holds pointers into itself and must outlive the build.
+			std::unique_ptr<PipelineConfigInfo> Config;
+			// A stage whose code is set is built from that SPIR-V and its path only names it; the others are
+			// read from their files.
+			std::span<const uint32_t> VertCode{};
+			std::span<const uint32_t> FragCode{};
+
+			std::shared_ptr<const ShaderModuleCache::Module> LoadVertShader(ShaderModuleCache& Shaders) const;
+			std::shared_ptr<const ShaderModuleCache::Module> LoadFragShader(ShaderModuleCache& Shaders) const;
+		};
+
+		struct BenchmarkResult {
+			size_t PipelineCount = 0;
+			uint32_t ThreadCount = 0;
+			double SerialMs = 0.0;
+			double ParallelMs = 0.0;
+		};
+
+		struct Timings {
+			uint32_t MonolithicPipelines = 0;
+			double MonolithicMs = 0.0;
+			PipelineLibraryCache::Stats Libraries{};
+		};
+
+		// 0 picks one thread per hardware thread, leaving one for the caller. With useLibraries, pipelines are
+		// fast-linked from graphics pipeline libraries where the device supports them and compiled as one
+		// monolithic pipeline otherwise.
+		PipelineCompiler(VulkanDevice& device, uint32_t threadCount = 0, bool useLibraries = true);
+		~PipelineCompiler();
+
+		PipelineCompiler(const PipelineCompiler&) = delete;
+		PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+		std::future<std::unique_ptr<Pipeline>> Compile(Request request);
+		// Same as Compile, for results that several owners hold on to.
+		std::shared_future<std::shared_ptr<Pipeline>> CompileShared(Request request);
+		std::vector<std::unique_ptr<Pipeline>> CompileAll(std::vector<Request> requests);
+
+		// Builds the same set of requests serially on the calling thread and then on the pool, each run
+		// against its own empty VkPipelineCache so neither benefits from the other.
+		BenchmarkResult Benchmark(const std::function<std::vector<Request>()>& makeRequests);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(Workers.size()); }
+		bool UsesLibraries() const { return Libraries != nullptr; }
+		Timings GetTimings() const;
+
+	private:
+		std::unique_ptr<Pipeline> Build(const Request& request);
+		std::unique_ptr<Pipeline> BuildMonolithic(const Request& request);
+		void Enqueue(std::function<void()> job);
+		void WorkerLoop();
+
+		VulkanDevice& Device;
+		// Destroyed after the workers are joined, so queued optimized links never outlive it.
+		std::unique_ptr<PipelineLibraryCache> Libraries;
+		std::vector<std::thread> Workers;
+		std::queue<std::function<void()>> Jobs;
+		std::mutex Mutex;
+		std::condition_variable JobAvailable;
+		bool Stopping = false;
+		Timings CompileTimings{};
+		mutable std::mutex TimingsMutex;
+	};
+}
@@ -0,0 +1,241 @@
+#include "PipelineLibraryCache.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace vlkn {
+
+	namespace {
+		using Clock = std::chrono::high_resolution_clock;
+
+		double MsSince(Clock::time_point Start)
+		{
+			return std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+		}
+
+		VkPipelineShaderStageCreateInfo MakeStage(VkShaderStageFlagBits Stage, const ShaderModuleCache::Module& Shader,
+			const VkSpecializationInfo* pSpecializationInfo)
+		{
+			VkPipelineShaderStageCreateInfo Info{};
+			Info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			Info.stage = Stage;
+			Info.pName = "main";
+			Shader.FillStage(Info);
+			Info.pSpecializationInfo = pSpecializationInfo;
+			return Info;
+		}
+	}
+
+	PipelineLibraryCache::PipelineLibraryCache(VulkanDevice& device, JobQueue enqueue) : Device{ device }, Enqueue{ std::move(enqueue) }
+	{
+	}
+
+	PipelineLibrarySet PipelineLibraryCache::GetLibraries(const PipelineConfigInfo& Config, const ShaderModuleCache::Module& VertShader,
+		const ShaderModuleCache::Module& FragShader)
+	{
+		// The state below must stay alive until every part is created, so the fill callbacks only point at it.
+		VkSpecializationInfo SpecializationInfo = Config.specialization.GetInfo();
+		const VkSpecializationInfo* pSpecializationInfo = Config.specialization.IsEmpty() ? nullptr : &SpecializationInfo;
+		VkPipelineShaderStageCreateInfo VertStage = MakeStage(VK_SHADER_STAGE_VERTEX_BIT, VertShader, pSpecializationInfo);
+		VkPipelineShaderStageCreateInfo FragStage = MakeStage(VK_SHADER_STAGE_FRAGMENT_BIT, FragShader, pSpecializationInfo);
+
+		VkPipelineVertexInputStateCreateInfo VertexInputInfo{};
+		VertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		VertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(Config.attributeDescriptions.size());
+		VertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(Config.bindingDescriptions.size());
+		VertexInputInfo.pVertexAttributeDescriptions = Config.attributeDescriptions.data();
+		VertexInputInfo.pVertexBindingDescriptions = Config.bindingDescriptions.data();
+
+		VkPipelineRenderingCreateInfo RenderingInfo = Config.GetRenderingCreateInfo();
+		const VkPipelineRenderingCreateInfo* Rendering = Config.renderPass == VK_NULL_HANDLE ? &RenderingInfo : nullptr;
+
+		PipelineLibrarySet Parts;
+		{
+			PipelineStateKey Key;
+			PipelineKeyWriter Writer{ Key };
+			WriteVertexInputState(Writer, Config);
+			Parts[0] = GetOrCreate(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, std::move(Key), nullptr,
+				[&](VkGraphicsPipelineCreateInfo& Info) {
+					Info.pVertexInputState = &VertexInputInfo;
+					Info.pInputAssemblyState = &Config.inputAssemblyInfo;
+					Info.pDynamicState = &Config.DynamicStateInfo;
+				});
+		}
+		{
+			PipelineStateKey Key;
+			PipelineKeyWriter Writer{ Key };
+			WritePreRasterizationState(Writer, Config, VertShader);
+			Parts[1] = GetOrCreate(VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, std::move(Key), Rendering,
+				[&](VkGraphicsPipelineCreateInfo& Info) {
+					Info.stageCount = 1;
+					Info.pStages = &VertStage;
+					Info.pViewportState = &Config.viewportInfo;
+					Info.pRasterizationState = &Config.rasterizationInfo;
+					Info.pDynamicState = &Config.DynamicStateInfo;
+					Info.layout = Config.pipelineLayout;
+					Info.renderPass = Config.renderPass;
+					Info.subpass = Config.subpass;
+				});
+		}
+		{
+			PipelineStateKey Key;
+			PipelineKeyWriter Writer{ Key };
+			WriteFragmentShaderState(Writer, Config, FragShader);
+			Parts[2] = GetOrCreate(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, std::move(Key), Rendering,
+				[&](VkGraphicsPipelineCreateInfo& Info) {
+					Info.stageCount = 1;
+					Info.pStages = &FragStage;
+					Info.pDepthStencilState = &Config.depthStencilInfo;
+					Info.pMultisampleState = &Config.multisampleInfo;
+					Info.pDynamicState = &Config.DynamicStateInfo;
+					Info.layout = Config.pipelineLayout;
+					Info.renderPass = Config.renderPass;
+					Info.subpass = Config.subpass;
+				});
+		}
+		{
+			PipelineStateKey Key;
+			PipelineKeyWriter Writer{ Key };
+			WriteFragmentOutputState(Writer, Config);
+			Parts[3] = GetOrCreate(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, std::move(Key), Rendering,
+				[&](VkGraphicsPipelineCreateInfo& Info) {
+					Info.pColorBlendState = &Config.colorBlendInfo;
+					Info.pMultisampleState = &Config.multisampleInfo;
+					Info.pDynamicState = &Config.DynamicStateInfo;
+					Info.renderPass = Config.renderPass;
+					Info.subpass = Config.subpass;
+				});
+		}
+		return Parts;
+	}
+
+	VkPipeline PipelineLibraryCache::FastLink(const PipelineLibrarySet& Parts, VkPipelineLayout Layout)
+	{
+		return Link(Parts, Layout, false);
+	}
+
+	void PipelineLibraryCache::LinkOptimizedAsync(PipelineLibrarySet Parts, VkPipelineLayout Layout, std::string Name,
+		std::function<void(VkPipeline)> onLinked)
+	{
+		Enqueue([this, Parts = std::move(Parts), Layout, Name = std::move(Name), OnLinked = std::move(onLinked)]() {
+			auto Start = Clock::now();
+			VkPipeline Optimized;
+			try
+			{
+				Optimized = Link(Parts, Layout, true);
+			}
+			catch (const std::exception& e)
+			{
+				std::cout << "Optimized link of pipeline " + Name + " failed, keeping the fast-linked one: " + e.what() + "\n";
+				return;
+			}
+
+			std::ostringstream Log;
+			Log << "Pipeline " << Name << " optimized link finished in " << MsSince(Start) << " ms\n";
+			std::cout << Log.str();
+			OnLinked(Optimized);
+		});
+	}
+
+	PipelineLibraryCache::Stats PipelineLibraryCache::GetStats() const
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		return CacheStats;
+	}
+
+	std::shared_ptr<const PipelineLibrary> PipelineLibraryCache::GetOrCreate(VkGraphicsPipelineLibraryFlagsEXT Part, PipelineStateKey Key,
+		const VkPipelineRenderingCreateInfo* Rendering, const PartState& FillState)
+	{
+		// The part leads the key so two different parts can never share an entry.
+		Key.insert(Key.begin(), Part);
+		{
+			std::lock_guard<std::mutex> Lock{ Mutex };
+			auto It = Libraries.find(Key);
+			if (It != Libraries.end())
+			{
+				if (auto Existing = It->second.lock())
+				{
+					CacheStats.LibrariesShared++;
+					return Existing;
+				}
+			}
+		}
+
+		// Compiled without the lock so parts of different pipelines build concurrently. Two threads may race
+		// to build the same part; both copies are valid and the later one replaces the earlier in the cache.
+		VkGraphicsPipelineLibraryCreateInfoEXT LibraryInfo{};
+		LibraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+		LibraryInfo.pNext = Rendering;
+		LibraryInfo.flags = Part;
+
+		VkGraphicsPipelineCreateInfo Info{};
+		Info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		Info.pNext = &LibraryInfo;
+		// Retaining the link-time optimization info is what allows the optimized link later on.
+		Info.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+		Info.basePipelineHandle = VK_NULL_HANDLE;
+		Info.basePipelineIndex = -1;
+		FillState(Info);
+
+		auto Start = Clock::now();
+		VkPipeline Handle;
+		if (vkCreateGraphicsPipelines(Device.device(), Device.pipelineCache(), 1, &Info, nullptr, &Handle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Graphics Pipeline Library");
+		}
+		double Ms = MsSince(Start);
+		auto Created = std::make_shared<const PipelineLibrary>(Device.device(), Handle);
+
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		std::erase_if(Libraries, [](const auto& Entry) { return Entry.second.expired(); });
+		Libraries[std::move(Key)] = Created;
+		CacheStats.LibrariesCreated++;
+		CacheStats.LibraryCompileMs += Ms;
+		return Created;
+	}
+
+	VkPipeline PipelineLibraryCache::Link(const PipelineLibrarySet& Parts, VkPipelineLayout Layout, bool Optimize)
+	{
+		std::array<VkPipeline, 4> Handles;
+		for (size_t i = 0; i < Parts.size(); i++)
+		{
+			Handles[i] = Parts[i]->GetHandle();
+		}
+
+		VkPipelineLibraryCreateInfoKHR LinkInfo{};
+		LinkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+		LinkInfo.libraryCount = static_cast<uint32_t>(Handles.size());
+		LinkInfo.pLibraries = Handles.data();
+
+		VkGraphicsPipelineCreateInfo Info{};
+		Info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		Info.pNext = &LinkInfo;
+		Info.flags = Optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+		Info.layout = Layout;
+		Info.basePipelineHandle = VK_NULL_HANDLE;
+		Info.basePipelineIndex = -1;
+
+		auto Start = Clock::now();
+		VkPipeline Linked;
+		if (vkCreateGraphicsPipelines(Device.device(), Device.pipelineCache(), 1, &Info, nullptr, &Linked) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Link Graphics Pipeline");
+		}
+		double Ms = MsSince(Start);
+
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		if (Optimize)
+		{
+			CacheStats.OptimizedLinks++;
+			CacheStats.OptimizedLinkMs += Ms;
+		}
+		else
+		{
+			CacheStats.FastLinks++;
+			CacheStats.FastLinkMs += Ms;
+		}
+		return Linked;
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Pipeline.hpp"
+#include "PipelineStateKey.hpp"
+#include "ShaderModuleCache.hpp"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace vlkn {
+
+	// One part of a pipeline built with VK_EXT_graphics_pipeline_library. Destroyed with its last user.
+	class PipelineLibrary {
+	public:
+		PipelineLibrary(VkDevice device, VkPipeline handle) : Device{ device }, Handle{ handle } {}
+		~PipelineLibrary() { vkDestroyPipeline(Device, Handle, nullptr); }
+
+		PipelineLibrary(const PipelineLibrary&) = delete;
+		PipelineLibrary& operator=(const PipelineLibrary&) = delete;
+
+		VkPipeline GetHandle() const { return Handle; }
+
+	private:
+		VkDevice Device;
+		VkPipeline Handle;
+	};
+
+	// Vertex input, pre-rasterization, fragment shader and fragment output, in that order.
+	using PipelineLibrarySet = std::array<std::shared_ptr<const PipelineLibrary>, 4>;
+
+	// Compiles the four graphics pipeline library parts separately and shares each between every pipeline
+	// with the same state for that part, so a new variant usually only compiles the stages it changes and
+	// then fast-links. Link-time optimized pipelines are linked from the same parts on the job queue.
+	class PipelineLibraryCache {
+	public:
+		struct Stats {
+			uint32_t LibrariesCreated = 0;
+			uint32_t LibrariesShared = 0;
+			double LibraryCompileMs = 0.0;
+			uint32_t FastLinks = 0;
+			double FastLinkMs = 0.0;
+			uint32_t OptimizedLinks = 0;
+			double OptimizedLinkMs = 0.0;
+		};
+
+		using JobQueue = std::function<void(std::function<void()>)>;
+
+		// Only valid on a device with VK_EXT_graphics_pipeline_library enabled.
+		PipelineLibraryCache(VulkanDevice& device, JobQueue enqueue);
+
+		PipelineLibraryCache(const PipelineLibraryCache&) = delete;
+		PipelineLibraryCache& operator=(const PipelineLibraryCache&) = delete;
+
+		// Compiles only the parts that are not cached yet.
+		PipelineLibrarySet GetLibraries(const PipelineConfigInfo& Config, const ShaderModuleCache::Module& VertShader,
+			const ShaderModuleCache::Module& FragShader);
+
+		VkPipeline FastLink(const PipelineLibrarySet& Parts, VkPipelineLayout Layout);
+		// Calls onLinked with the optimized pipeline, which it then owns, from a job queue thread. A failed
+		// link is logged and onLinked is never called.
+		void LinkOptimizedAsync(PipelineLibrarySet Parts, VkPipelineLayout Layout, std::string Name,
+			std::function<void(VkPipeline)> onLinked);
+
+		Stats GetStats() const;
+
+	private:
+		using PartState = std::function<void(VkGraphicsPipelineCreateInfo&)>;
+
+		// Rendering is chained in for parts that need the attachment formats of a pipeline without a render pass.
+		std::shared_ptr<const PipelineLibrary> GetOrCreate(VkGraphicsPipelineLibraryFlagsEXT Part, PipelineStateKey Key,
+			const VkPipelineRenderingCreateInfo* Rendering, const PartState& FillState);
+		VkPipeline Link(const PipelineLibrarySet& Parts, VkPipelineLayout Layout, bool Optimize);
+
+		VulkanDevice& Device;
+		JobQueue Enqueue;
+		// Weak so parts are destroyed once no pipeline uses them; expired entries are replaced on lookup.
+		std::unordered_map<PipelineStateKey, std::weak_ptr<const PipelineLibrary>, PipelineStateKeyHash> Libraries;
+		Stats CacheStats{};
+		mutable std::mutex Mutex;
+	};
+}
@@ -0,0 +1,92 @@
+#include "PipelineRegistry.hpp"
+#include "ShaderModuleCache.hpp"
+
+#include <chrono>
+
+namespace vlkn {
+
+	PipelineRegistry::PipelineRegistry(VulkanDevice& device, PipelineCompiler& compiler) : Device{ device }, Compiler{ compiler }
+	{
+	}
+
+	std::shared_future<std::shared_ptr<Pipeline>> PipelineRegistry::Request(PipelineCompiler::Request request)
+	{
+		auto& Shaders = Device.shaderModuleCache();
+		auto VertShader = request.LoadVertShader(Shaders);
+		auto FragShader = request.LoadFragShader(Shaders);
+		StateKey Key = BuildKey(*request.Config, *VertShader, *FragShader);
+
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		RegistryStats.Requests++;
+
+		auto It = Pipelines.find(Key);
+		if (It != Pipelines.end())
+		{
+			RegistryStats.Deduplicated++;
+			return It->second.Build;
+		}
+
+		// The entry keeps the modules loaded above alive, so the compile reuses them instead of recreating them.
+		Entry Created{ Compiler.CompileShared(std::move(request)), std::move(VertShader), std::move(FragShader) };
+		auto Shared = Created.Build;
+		Pipelines.emplace(std::move(Key), std::move(Created));
+		RegistryStats.UniquePipelines++;
+		return Shared;
+	}
+
+	uint32_t PipelineRegistry::Prune()
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+
+		uint32_t Pruned = 0;
+		for (auto It = Pipelines.begin(); It != Pipelines.end();)
+		{
+			// Builds still in flight are kept. Holders of a future rather than the pointer itself don't show up
+			// in use_count, but the shared state keeps the Pipeline alive for them regardless.
+			bool Unused = false;
+			const auto& Future = It->second.Build;
+			if (Future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			{
+				try
+				{
+					Unused = Future.get().use_count() == 1;
+				}
+				catch (const std::exception&)
+				{
+					Unused = true;
+				}
+			}
+
+			if (Unused)
+			{
+				It = Pipelines.erase(It);
+				Pruned++;
+			}
+			else
+			{
+				++It;
+			}
+		}
+
+		RegistryStats.UniquePipelines -= Pruned;
+		return Pruned;
+	}
+
+	PipelineRegistry::Stats PipelineRegistry::GetStats() const
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		return RegistryStats;
+	}
+
+	PipelineRegistry::StateKey PipelineRegistry::BuildKey(const PipelineConfigInfo& Config, const ShaderModuleCache::Module& VertShader,
+		const ShaderModuleCache::Module& FragShader)
+	{
+		StateKey Key;
+		PipelineKeyWriter Writer{ Key };
+		WriteVertexInputState(Writer, Config);
+		WritePreRasterizationState(Writer, Config, VertShader);
+		WriteFragmentShaderState(Writer, Config, FragShader);
+		WriteFragmentOutputState(Writer, Config);
+		return Key;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Pipeline.hpp"
+#include "PipelineCompiler.hpp"
+#include "PipelineStateKey.hpp"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vlkn {
+
+	// Deduplicates pipelines by their full state. Requests whose PipelineConfigInfo and SPIR-V match an
+	// earlier one get the same Pipeline back, including while that pipeline is still compiling, so
+	// callers can compare Pipeline pointers to skip redundant binds. Pipelines live as long as the registry.
+	class PipelineRegistry {
+	public:
+		struct Stats {
+			uint32_t Requests = 0;
+			uint32_t UniquePipelines = 0;
+			uint32_t Deduplicated = 0;
+		};
+
+		PipelineRegistry(VulkanDevice& device, PipelineCompiler& compiler);
+
+		PipelineRegistry(const PipelineRegistry&) = delete;
+		PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+		// Starts compiling on the compiler's threads if no identical pipeline exists yet.
+		std::shared_future<std::shared_ptr<Pipeline>> Request(PipelineCompiler::Request request);
+		std::shared_ptr<Pipeline> Get(PipelineCompiler::Request request) { return Request(std::move(request)).get(); }
+
+		// Drops finished pipelines that nobody outside the registry holds any more, and failed builds so
+		// they can be retried. Callers must make sure the GPU is done with the pipelines they released.
+		uint32_t Prune();
+
+		Stats GetStats() const;
+
+	private:
+		using StateKey = PipelineStateKey;
+
+		struct Entry {
+			std::shared_future<std::shared_ptr<Pipeline>> Build;
+			std::shared_ptr<const ShaderModuleCache::Module> VertShader;
+			std::shared_ptr<const ShaderModuleCache::Module> FragShader;
+		};
+
+		static StateKey BuildKey(const PipelineConfigInfo& Config, const ShaderModuleCache::Module& VertShader,
+			const ShaderModuleCache::Module& FragShader);
+
+		VulkanDevice& Device;
+		PipelineCompiler& Compiler;
+		std::unordered_map<StateKey, Entry, PipelineStateKeyHash> Pipelines;
+		Stats RegistryStats{};
+		mutable std::mutex Mutex;
+	};
+}
@@ -0,0 +1,168 @@
+#include "PipelineStateKey.hpp"
+#include "Utils.hpp"
+
+namespace vlkn {
+
+	namespace {
+		void WriteStencil(PipelineKeyWriter& Writer, const VkStencilOpState& State)
+		{
+			Writer << State.failOp << State.passOp << State.depthFailOp << State.compareOp
+				<< State.compareMask << State.writeMask << State.reference;
+		}
+
+		// Written in full rather than as the module hash, so two different shaders never share a key.
+		void WriteShader(PipelineKeyWriter& Writer, const ShaderModuleCache::Module& Shader)
+		{
+			const auto& Code = Shader.GetCode();
+			Writer << static_cast<uint32_t>(Code.size());
+			for (uint32_t Word : Code)
+			{
+				Writer << Word;
+			}
+		}
+
+		void WriteSpecialization(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config)
+		{
+			VkSpecializationInfo Specialization = Config.specialization.GetInfo();
+			Writer << Specialization.mapEntryCount;
+			for (uint32_t i = 0; i < Specialization.mapEntryCount; i++)
+			{
+				const auto& Entry = Specialization.pMapEntries[i];
+				uint32_t Value = 0;
+				memcpy(&Value, static_cast<const char*>(Specialization.pData) + Entry.offset, Entry.size);
+				Writer << Entry.constantID << Value;
+			}
+		}
+
+		void WriteDynamicState(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config)
+		{
+			Writer << Config.DynamicStateEnables.size();
+			for (VkDynamicState State : Config.DynamicStateEnables)
+			{
+				Writer << State;
+			}
+		}
+
+		// Dynamic state is left out of the key so pipelines that only differ in it are shared.
+		template <typename T>
+		void WriteUnlessDynamic(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config, VkDynamicState State, const T& Value)
+		{
+			if (Config.IsDynamic(State))
+			{
+				Writer << 0u;
+			}
+			else
+			{
+				Writer << Value;
+			}
+		}
+
+		void WriteRenderTarget(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config)
+		{
+			Writer << Config.renderPass << Config.subpass << Config.colorAttachmentFormats.size();
+			for (VkFormat Format : Config.colorAttachmentFormats)
+			{
+				Writer << Format;
+			}
+			Writer << Config.depthAttachmentFormat;
+		}
+
+		void WriteMultisample(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config)
+		{
+			const auto& Multisample = Config.multisampleInfo;
+			Writer << Multisample.rasterizationSamples << Multisample.sampleShadingEnable << Multisample.minSampleShading
+				<< Multisample.alphaToCoverageEnable << Multisample.alphaToOneEnable;
+		}
+	}
+
+	size_t PipelineStateKeyHash::operator()(const PipelineStateKey& key) const
+	{
+		size_t Seed = 0;
+		for (uint32_t Word : key)
+		{
+			hashCombine(Seed, Word);
+		}
+		return Seed;
+	}
+
+	void WriteVertexInputState(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config)
+	{
+		Writer << Config.bindingDescriptions.size();
+		for (const auto& Binding : Config.bindingDescriptions)
+		{
+			Writer << Binding.binding << Binding.stride << Binding.inputRate;
+		}
+		Writer << Config.attributeDescriptions.size();
+		for (const auto& Attribute : Config.attributeDescriptions)
+		{
+			Writer << Attribute.location << Attribute.binding << Attribute.format << Attribute.offset;
+		}
+
+		WriteUnlessDynamic(Writer, Config, VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY, Config.inputAssemblyInfo.topology);
+		Writer << Config.inputAssemblyInfo.primitiveRestartEnable;
+		WriteDynamicState(Writer, Config);
+	}
+
+	// Render passes are keyed by handle rather than by compatibility class, which can only cause extra
+	// pipelines, never a wrong one.
+	void WritePreRasterizationState(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config, const ShaderModuleCache::Module& VertShader)
+	{
+		// Shaders are identified by content, so the same SPIR-V under two paths is one pipeline.
+		WriteShader(Writer, VertShader);
+		WriteSpecialization(Writer, Config);
+
+		Writer << Config.viewportInfo.viewportCount << Config.viewportInfo.scissorCount;
+
+		const auto& Raster = Config.rasterizationInfo;
+		Writer << Raster.depthClampEnable << Raster.rasterizerDiscardEnable;
+		WriteUnlessDynamic(Writer, Config, VK_DYNAMIC_STATE_POLYGON_MODE_EXT, Raster.polygonMode);
+		WriteUnlessDynamic(Writer, Config, VK_DYNAMIC_STATE_CULL_MODE, Raster.cullMode);
+		WriteUnlessDynamic(Writer, Config, VK_DYNAMIC_STATE_FRONT_FACE, Raster.frontFace);
+		WriteUnlessDynamic(Writer, Config, VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE, Raster.depthBiasEnable);
+		Writer << Raster.depthBiasConstantFactor << Raster.depthBiasClamp << Raster.depthBiasSlopeFactor << Raster.lineWidth;
+
+		WriteDynamicState(Writer, Config);
+		Writer << Config.pipelineLayout;
+		WriteRenderTarget(Writer, Config);
+	}
+
+	void WriteFragmentShaderState(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config, const ShaderModuleCache::Module& FragShader)
+	{
+		WriteShader(Writer, FragShader);
+		WriteSpecialization(Writer, Config);
+
+		const auto& Depth = Config.depthStencilInfo;
+		WriteUnlessDynamic(Writer, Config, VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE, Depth.depthTestEnable);
+		WriteUnlessDynamic(Writer, Config, VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE, Depth.depthWriteEnable);
+		WriteUnlessDynamic(Writer, Config, VK_DYNAMIC_STATE_DEPTH_COMPARE_OP, Depth.depthCompareOp);
+		Writer << Depth.depthBoundsTestEnable << Depth.stencilTestEnable << Depth.minDepthBounds << Depth.maxDepthBounds;
+		WriteStencil(Writer, Depth.front);
+		WriteStencil(Writer, Depth.back);
+		WriteMultisample(Writer, Config);
+
+		WriteDynamicState(Writer, Config);
+		Writer << Config.pipelineLayout;
+		WriteRenderTarget(Writer, Config);
+	}
+
+	void WriteFragmentOutputState(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config)
+	{
+		const auto& Blend = Config.colorBlendInfo;
+		Writer << Blend.logicOpEnable << Blend.logicOp << Blend.attachmentCount;
+		for (uint32_t i = 0; i < Blend.attachmentCount; i++)
+		{
+			const auto& Attachment = Blend.pAttachments[i];
+			Writer << Attachment.blendEnable << Attachment.srcColorBlendFactor << Attachment.dstColorBlendFactor
+				<< Attachment.colorBlendOp << Attachment.srcAlphaBlendFactor << Attachment.dstAlphaBlendFactor
+				<< Attachment.alphaBlendOp << Attachment.colorWriteMask;
+		}
+		for (float Constant : Blend.blendConstants)
+		{
+			Writer << Constant;
+		}
+		WriteMultisample(Writer, Config);
+
+		WriteDynamicState(Writer, Config);
+		WriteRenderTarget(Writer, Config);
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Pipeline.hpp"
+#include "ShaderModuleCache.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace vlkn {
+
+	// Flattened pipeline state. Compared in full, so a hash collision can't alias two pipelines.
+	using PipelineStateKey = std::vector<uint32_t>;
+
+	struct PipelineStateKeyHash {
+		size_t operator()(const PipelineStateKey& key) const;
+	};
+
+	class PipelineKeyWriter {
+	public:
+		PipelineKeyWriter(PipelineStateKey& key) : Key{ key } {}
+
+		template <typename T>
+		PipelineKeyWriter& operator<<(const T& value)
+		{
+			if constexpr (std::is_pointer_v<T>)
+			{
+				Write64(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+			}
+			else if constexpr (std::is_floating_point_v<T>)
+			{
+				uint32_t Bits;
+				float AsFloat = static_cast<float>(value);
+				memcpy(&Bits, &AsFloat, sizeof(Bits));
+				Key.push_back(Bits);
+			}
+			else if constexpr (sizeof(T) == sizeof(uint64_t))
+			{
+				Write64(static_cast<uint64_t>(value));
+			}
+			else
+			{
+				Key.push_back(static_cast<uint32_t>(value));
+			}
+			return *this;
+		}
+
+	private:
+		void Write64(uint64_t value)
+		{
+			Key.push_back(static_cast<uint32_t>(value));
+			Key.push_back(static_cast<uint32_t>(value >> 32));
+		}
+
+		PipelineStateKey& Key;
+	};
+
+	// One writer per graphics pipeline library part, so a full pipeline key is the four parts in sequence.
+	// Each part includes everything its library is created from, including the dynamic states.
+	void WriteVertexInputState(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config);
+	void WritePreRasterizationState(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config, const ShaderModuleCache::Module& VertShader);
+	void WriteFragmentShaderState(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config, const ShaderModuleCache::Module& FragShader);
+	void WriteFragmentOutputState(PipelineKeyWriter& Writer, const PipelineConfigInfo& Config);
+}
@@ -0,0 +1,70 @@
+#include "RenderState.hpp"
+#include "Utils.hpp"
+
+namespace vlkn {
+
+	size_t RenderState::Hash::operator()(const RenderState& state) const
+	{
+		size_t Seed = 0;
+		hashCombine(Seed, state.CullMode, state.FrontFace, state.Topology, state.DepthTest, state.DepthWrite,
+			state.DepthCompareOp, state.DepthBias, state.PolygonMode);
+		return Seed;
+	}
+
+	RenderStateRecorder::RenderStateRecorder(VulkanDevice& device)
+	{
+		if (device.dynamicPolygonModeEnabled())
+		{
+			CmdSetPolygonMode = reinterpret_cast<PFN_vkCmdSetPolygonModeEXT>(
+				vkGetDeviceProcAddr(device.device(), "vkCmdSetPolygonModeEXT"));
+		}
+	}
+
+	void RenderStateRecorder::Apply(VkCommandBuffer CommandBuffer, const RenderState& State)
+	{
+		const bool All = !HasCurrent;
+		if (All || State.CullMode != Current.CullMode)
+		{
+			vkCmdSetCullMode(CommandBuffer, State.CullMode);
+			CommandCount++;
+		}
+		if (All || State.FrontFace != Current.FrontFace)
+		{
+			vkCmdSetFrontFace(CommandBuffer, State.FrontFace);
+			CommandCount++;
+		}
+		if (All || State.Topology != Current.Topology)
+		{
+			vkCmdSetPrimitiveTopology(CommandBuffer, State.Topology);
+			CommandCount++;
+		}
+		if (All || State.DepthTest != Current.DepthTest)
+		{
+			vkCmdSetDepthTestEnable(CommandBuffer, State.DepthTest ? VK_TRUE : VK_FALSE);
+			CommandCount++;
+		}
+		if (All || State.DepthWrite != Current.DepthWrite)
+		{
+			vkCmdSetDepthWriteEnable(CommandBuffer, State.DepthWrite ? VK_TRUE : VK_FALSE);
+			CommandCount++;
+		}
+		if (All || State.DepthCompareOp != Current.DepthCompareOp)
+		{
+			vkCmdSetDepthCompareOp(CommandBuffer, State.DepthCompareOp);
+			CommandCount++;
+		}
+		if (All || State.DepthBias != Current.DepthBias)
+		{
+			vkCmdSetDepthBiasEnable(CommandBuffer, State.DepthBias ? VK_TRUE : VK_FALSE);
+			CommandCount++;
+		}
+		if (CmdSetPolygonMode != nullptr && (All || State.PolygonMode != Current.PolygonMode))
+		{
+			CmdSetPolygonMode(CommandBuffer, State.PolygonMode);
+			CommandCount++;
+		}
+
+		Current = State;
+		HasCurrent = true;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+
+#include <cstddef>
+
+namespace vlkn {
+
+	// Fixed-function state set per draw on pipelines built with Pipeline::EnableDynamicRenderState, so
+	// objects that only differ in this state share one pipeline.
+	struct RenderState {
+		VkCullModeFlags CullMode = VK_CULL_MODE_NONE;
+		VkFrontFace FrontFace = VK_FRONT_FACE_CLOCKWISE;
+		// Must stay in the pipeline's topology class, e.g. a triangle list pipeline can draw strips but not lines.
+		VkPrimitiveTopology Topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		bool DepthTest = true;
+		bool DepthWrite = true;
+		VkCompareOp DepthCompareOp = VK_COMPARE_OP_LESS;
+		bool DepthBias = false;
+		// Needs VK_EXT_extended_dynamic_state3; ignored, and the pipeline's fill mode used, without it.
+		VkPolygonMode PolygonMode = VK_POLYGON_MODE_FILL;
+
+		bool operator==(const RenderState& other) const
+		{
+			return CullMode == other.CullMode && FrontFace == other.FrontFace && Topology == other.Topology &&
+				DepthTest == other.DepthTest && DepthWrite == other.DepthWrite && DepthCompareOp == other.DepthCompareOp &&
+				DepthBias == other.DepthBias && PolygonMode == other.PolygonMode;
+		}
+		bool operator!=(const RenderState& other) const { return !(*this == other); }
+
+		struct Hash {
+			size_t operator()(const RenderState& state) const;
+		};
+	};
+
+	// Records the dynamic state commands for a RenderState, skipping the values already set on the command buffer.
+	class RenderStateRecorder {
+	public:
+		RenderStateRecorder(VulkanDevice& device);
+
+		// Call whenever recording starts on a new command buffer, or after binding a pipeline with static state.
+		void Reset() { HasCurrent = false; }
+		void Apply(VkCommandBuffer CommandBuffer, const RenderState& State);
+
+		uint64_t GetCommandCount() const { return CommandCount; }
+
+	private:
+		PFN_vkCmdSetPolygonModeEXT CmdSetPolygonMode = nullptr;
+		RenderState Current{};
+		bool HasCurrent = false;
+		uint64_t CommandCount = 0;
+	};
+}
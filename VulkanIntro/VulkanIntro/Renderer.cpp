@@ -1,27 +1,53 @@
 #include "Renderer.hpp"
 
 #include <stdexcept>
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <iostream>
 
-vlkn::Renderer::Renderer(Window& window, VulkanDevice& Device)
+vlkn::Renderer::Renderer(Window& window, VulkanDevice& Device, FrameResources& Frames, bool useDynamicRendering,
+	const PresentSettings& present)
 	:
 	window{window},
-	Device{Device}
+	Device{Device},
+	Frames{Frames},
+	UseDynamicRendering{useDynamicRendering && Device.dynamicRenderingEnabled()},
+	Present{present},
+	RequestedPresent{present}
 {
+	if (Present.policy == PresentPolicy::LowLatency)
+	{
+		FramesBeforeLowLatency = Frames.GetRequestedFramesInFlight();
+		Frames.RequestFramesInFlight(1);
+	}
 	RecreateSwapchain();
 	CreateCommandBuffers();
+	FramesRegistration = Frames.Register([this](uint32_t frameCount) { ResizeFrames(frameCount); });
+	if (Frames.UsesTimeline())
+	{
+		LatencyThread = std::thread(&Renderer::LatencyLoop, this);
+	}
 }
 
 vlkn::Renderer::~Renderer()
 {
+	if (LatencyThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> Lock{ LatencyMutex };
+			StopLatencyThread = true;
+		}
+		LatencyAvailable.notify_one();
+		LatencyThread.join();
+	}
 	FreeCommandBuffers();
 }
 
 
 void vlkn::Renderer::CreateCommandBuffers()
 {
-	CommandBuffers.resize(Swapchain::MAX_FRAMES_IN_FLIGHT);
+	CommandBuffers.resize(Frames.GetFramesInFlight());
 
 	VkCommandBufferAllocateInfo CBAllocateInfo{};
 	CBAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -44,6 +70,15 @@ void vlkn::Renderer::FreeCommandBuffers()
 }
 
 
+// Called with the device idle, between frames.
+void vlkn::Renderer::ResizeFrames(uint32_t frameCount)
+{
+	FreeCommandBuffers();
+	CreateCommandBuffers();
+	swapchain->setFramesInFlight(frameCount);
+	CurrentFrameIndex = 0;
+}
+
 void vlkn::Renderer::RecreateSwapchain()
 {
 	auto extent = window.getExtent();
@@ -56,11 +91,11 @@ void vlkn::Renderer::RecreateSwapchain()
 
 	if (swapchain == nullptr)
 	{
-		swapchain = std::make_unique<Swapchain>(Device, extent);
+		swapchain = std::make_unique<Swapchain>(Device, extent, Frames, Present, UseDynamicRendering);
 	}
 	else {
 		std::shared_ptr<Swapchain> oldSwapchain = std::move(swapchain);
-		swapchain = std::make_unique<Swapchain>(Device, extent, oldSwapchain);
+		swapchain = std::make_unique<Swapchain>(Device, extent, oldSwapchain, Present);
 
 		if (!oldSwapchain->CompareSwapFormats(*swapchain.get()))
 		{
@@ -75,9 +110,117 @@ void vlkn::Renderer::RecreateSwapchain()
 
 
 
+// Called between frames.
+void vlkn::Renderer::ApplyPresentSettings()
+{
+	bool WasLowLatency = Present.policy == PresentPolicy::LowLatency;
+	bool IsLowLatency = RequestedPresent.policy == PresentPolicy::LowLatency;
+	if (IsLowLatency && !WasLowLatency)
+	{
+		FramesBeforeLowLatency = Frames.GetFramesInFlight();
+		Frames.RequestFramesInFlight(1);
+	}
+	else if (WasLowLatency && !IsLowLatency)
+	{
+		Frames.RequestFramesInFlight(FramesBeforeLowLatency);
+	}
+
+	Present = RequestedPresent;
+	RecreateSwapchain();
+}
+
+void vlkn::Renderer::RequestFramesInFlight(uint32_t count)
+{
+	if (Present.policy == PresentPolicy::LowLatency)
+	{
+		FramesBeforeLowLatency = count;
+	}
+	else
+	{
+		Frames.RequestFramesInFlight(count);
+	}
+}
+
+vlkn::Renderer::PresentLatencyStats vlkn::Renderer::GetPresentLatency(PresentPolicy policy) const
+{
+	std::lock_guard<std::mutex> Lock{ LatencyMutex };
+	return Latency[static_cast<int>(policy)];
+}
+
+// Call with LatencyMutex held.
+void vlkn::Renderer::RecordLatency(const PendingLatency& Pending, std::chrono::high_resolution_clock::time_point CompletedTime)
+{
+	double Ms = std::chrono::duration<double, std::milli>(CompletedTime - Pending.InputTime).count();
+	PresentLatencyStats& Stats = Latency[static_cast<int>(Pending.Policy)];
+	Stats.FrameCount++;
+	Stats.TotalMs += Ms;
+	Stats.MaxMs = std::max(Stats.MaxMs, Ms);
+}
+
+// Fences only; completion is known right after the wait at the start of a frame.
+void vlkn::Renderer::RecordCompletedLatencies()
+{
+	uint64_t CompletedFrame = Frames.GetCompletedFrame();
+	auto Now = std::chrono::high_resolution_clock::now();
+	std::lock_guard<std::mutex> Lock{ LatencyMutex };
+	while (!PendingLatencies.empty() && PendingLatencies.front().Frame <= CompletedFrame)
+	{
+		RecordLatency(PendingLatencies.front(), Now);
+		PendingLatencies.pop_front();
+	}
+}
+
+// Timeline only. Waits for the oldest pending frame's timeline value, which is also fine before the frame has
+// been submitted, and timestamps it the moment it is reached.
+void vlkn::Renderer::LatencyLoop()
+{
+	// Bounds each wait so a stop request is noticed even if no further frame is submitted.
+	constexpr uint64_t WAIT_TIMEOUT_NS = 100'000'000;
+
+	std::unique_lock<std::mutex> Lock{ LatencyMutex };
+	while (true)
+	{
+		LatencyAvailable.wait(Lock, [this]() { return StopLatencyThread || !PendingLatencies.empty(); });
+		if (StopLatencyThread)
+		{
+			return;
+		}
+
+		PendingLatency Pending = PendingLatencies.front();
+		Lock.unlock();
+		bool Completed = false;
+		try
+		{
+			Completed = Frames.WaitForFrame(Pending.Frame, WAIT_TIMEOUT_NS);
+		}
+		catch (const std::exception& e)
+		{
+			// The render thread will hit the same error; only the measurement stops here.
+			std::cout << "Input latency measurement stopped: " << e.what() << "\n";
+			return;
+		}
+		auto Now = std::chrono::high_resolution_clock::now();
+		Lock.lock();
+
+		if (Completed)
+		{
+			RecordLatency(Pending, Now);
+			PendingLatencies.pop_front();
+		}
+	}
+}
+
+
+
 VkCommandBuffer vlkn::Renderer::BeginFrame()
 {
 	assert(!IsFrameStarted && "Cannot call BeginFrame while frame is already in progress.");
+	auto InputTime = std::chrono::high_resolution_clock::now();
+	if (RequestedPresent != Present)
+	{
+		ApplyPresentSettings();
+	}
+	Frames.ApplyPendingResize();
 	auto result = swapchain->acquireNextImage(&CurrentImgIndex);
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR)
@@ -92,6 +235,18 @@ VkCommandBuffer vlkn::Renderer::BeginFrame()
 	}
 
 	IsFrameStarted = true;
+	{
+		std::lock_guard<std::mutex> Lock{ LatencyMutex };
+		PendingLatencies.push_back({ Frames.GetCurrentFrame(), InputTime, Present.policy });
+	}
+	if (Frames.UsesTimeline())
+	{
+		LatencyAvailable.notify_one();
+	}
+	else
+	{
+		RecordCompletedLatencies();
+	}
 
 	auto CommandBuffer = GetCurrentCB();
 	VkCommandBufferBeginInfo BeginInfo{};
@@ -126,15 +281,53 @@ void vlkn::Renderer::EndFrame()
 		throw std::runtime_error("Failed to Present Swapchain Image");
 	}
 	IsFrameStarted = false;
-	CurrentFrameIndex = (CurrentFrameIndex + 1) % Swapchain::MAX_FRAMES_IN_FLIGHT;
+	CurrentFrameIndex = (CurrentFrameIndex + 1) % static_cast<int>(Frames.GetFramesInFlight());
 }
 
 
-void vlkn::Renderer::BeginSwapchainRenderPass(VkCommandBuffer CommandBuffer)
+vlkn::RenderTargetInfo vlkn::Renderer::GetSwapchainRenderTarget() const
+{
+	RenderTargetInfo Target{};
+	Target.RenderPass = swapchain->getRenderPass();
+	Target.ColorFormat = swapchain->getSwapChainImageFormat();
+	Target.DepthFormat = swapchain->getSwapChainDepthFormat();
+	return Target;
+}
+
+void vlkn::Renderer::BeginSwapchainRenderPass(VkCommandBuffer CommandBuffer, bool secondaryContents)
 {
 	assert(IsFrameStarted && "Cannot call BeginSwapchainRenderPass if the frame is not in progress");
 	assert(CommandBuffer == GetCurrentCB() && "Cannot begin RenderPass on Command Buffer from different Frame.");
 
+	if (UseDynamicRendering)
+	{
+		BeginSwapchainRendering(CommandBuffer, secondaryContents);
+	}
+	else
+	{
+		BeginSwapchainRenderPassObject(CommandBuffer, secondaryContents);
+	}
+
+	if (secondaryContents)
+	{
+		return;
+	}
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(swapchain->getSwapChainExtent().width);
+	viewport.height = static_cast<float>(swapchain->getSwapChainExtent().height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	VkRect2D scissor{ {0, 0}, swapchain->getSwapChainExtent() };
+	vkCmdSetViewport(CommandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(CommandBuffer, 0, 1, &scissor);
+
+}
+
+void vlkn::Renderer::BeginSwapchainRenderPassObject(VkCommandBuffer CommandBuffer, bool secondaryContents)
+{
 	VkRenderPassBeginInfo RenderPassInfo{};
 	RenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	RenderPassInfo.renderPass = swapchain->getRenderPass();
@@ -151,19 +344,70 @@ void vlkn::Renderer::BeginSwapchainRenderPass(VkCommandBuffer CommandBuffer)
 	RenderPassInfo.pClearValues = ClearValues.data();
 
 
-	vkCmdBeginRenderPass(CommandBuffer, &RenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(swapchain->getSwapChainExtent().width);
-	viewport.height = static_cast<float>(swapchain->getSwapChainExtent().height);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-	VkRect2D scissor{ {0, 0}, swapchain->getSwapChainExtent() };
-	vkCmdSetViewport(CommandBuffer, 0, 1, &viewport);
-	vkCmdSetScissor(CommandBuffer, 0, 1, &scissor);
+	vkCmdBeginRenderPass(CommandBuffer, &RenderPassInfo,
+		secondaryContents ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+}
 
+// The render pass did the layout transitions implicitly; here they are explicit barriers around vkCmdBeginRendering.
+void vlkn::Renderer::BeginSwapchainRendering(VkCommandBuffer CommandBuffer, bool secondaryContents)
+{
+	VkFormat DepthFormat = swapchain->getSwapChainDepthFormat();
+	bool HasStencil = DepthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || DepthFormat == VK_FORMAT_D24_UNORM_S8_UINT;
+
+	std::array<VkImageMemoryBarrier, 2> Barriers{};
+	Barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	Barriers[0].srcAccessMask = 0;
+	Barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	Barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	Barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	Barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barriers[0].image = swapchain->getImage(CurrentImgIndex);
+	Barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	// The depth image was last written when this swapchain image was rendered before.
+	Barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	Barriers[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	Barriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	Barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	Barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	Barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barriers[1].image = swapchain->getDepthImage(CurrentImgIndex);
+	Barriers[1].subresourceRange = { static_cast<VkImageAspectFlags>(VK_IMAGE_ASPECT_DEPTH_BIT | (HasStencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0)), 0, 1, 0, 1 };
+
+	// Color waits on the stage the image-available semaphore is waited at, as the render pass dependency did.
+	VkPipelineStageFlags Stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	vkCmdPipelineBarrier(CommandBuffer, Stages, Stages, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(Barriers.size()), Barriers.data());
+
+	VkRenderingAttachmentInfo ColorAttachment{};
+	ColorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	ColorAttachment.imageView = swapchain->getImageView(CurrentImgIndex);
+	ColorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	ColorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	ColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	ColorAttachment.clearValue.color = { 0.01f,0.01f,0.01f,1.0f };
+
+	VkRenderingAttachmentInfo DepthAttachment{};
+	DepthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	DepthAttachment.imageView = swapchain->getDepthImageView(CurrentImgIndex);
+	DepthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	DepthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	DepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	DepthAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+	VkRenderingInfo RenderingInfo{};
+	RenderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	RenderingInfo.flags = secondaryContents ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+	RenderingInfo.renderArea.offset = { 0, 0 };
+	RenderingInfo.renderArea.extent = swapchain->getSwapChainExtent();
+	RenderingInfo.layerCount = 1;
+	RenderingInfo.colorAttachmentCount = 1;
+	RenderingInfo.pColorAttachments = &ColorAttachment;
+	RenderingInfo.pDepthAttachment = &DepthAttachment;
+
+	vkCmdBeginRendering(CommandBuffer, &RenderingInfo);
 }
 
 void vlkn::Renderer::EndSwapchainRenderPass(VkCommandBuffer CommandBuffer)
@@ -171,6 +415,25 @@ void vlkn::Renderer::EndSwapchainRenderPass(VkCommandBuffer CommandBuffer)
 	assert(IsFrameStarted && "Cannot call EndSwapchainRenderPass if the frame is in progress");
 	assert(CommandBuffer == GetCurrentCB() && "Cannot end RenderPass on Command Buffer from different Frame.");
 
-	vkCmdEndRenderPass(CommandBuffer);
+	if (!UseDynamicRendering)
+	{
+		vkCmdEndRenderPass(CommandBuffer);
+		return;
+	}
+
+	vkCmdEndRendering(CommandBuffer);
+
+	VkImageMemoryBarrier PresentBarrier{};
+	PresentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	PresentBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	PresentBarrier.dstAccessMask = 0;
+	PresentBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	PresentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	PresentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	PresentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	PresentBarrier.image = swapchain->getImage(CurrentImgIndex);
+	PresentBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &PresentBarrier);
 }
 
@@ -3,9 +3,17 @@
 #include "Window.hpp"
 #include "VulkanDevice.hpp"
 #include "Swapchain.hpp"
+#include "FrameResources.hpp"
+#include "Pipeline.hpp"
 
 
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <cassert>
 
@@ -13,14 +21,42 @@ namespace vlkn {
 	class Renderer {
 	public:
 
-		Renderer(Window &window, VulkanDevice &Device);
+		// Time from the start of BeginFrame, right after input is sampled, until the frame has completed on the
+		// GPU; time waiting in the presentation queue afterwards is not included. With a frame timeline a helper
+		// thread waits on each frame and timestamps it as it completes. With fences completion is only noticed
+		// at frame boundaries, so those samples also include acquire and frame pacing and are approximate.
+		struct PresentLatencyStats {
+			uint64_t FrameCount = 0;
+			double TotalMs = 0.0;
+			double MaxMs = 0.0;
+		};
+
+		// Dynamic rendering is only used if the device supports it; otherwise the swapchain's render pass is.
+		Renderer(Window &window, VulkanDevice &Device, FrameResources& Frames, bool useDynamicRendering = false,
+			const PresentSettings& present = {});
 		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer& operator=(const Renderer&) = delete;
 
 		VkRenderPass GetSwapchainRenderPass() const { return swapchain->getRenderPass(); }
+		// Stays valid across swapchain recreation: the formats can't change, and the render pass is handed on
+		// to each new swapchain instead of being recreated.
+		RenderTargetInfo GetSwapchainRenderTarget() const;
+		bool UsesDynamicRendering() const { return UseDynamicRendering; }
 		float GetAspectRatio() const { return swapchain->extentAspectRatio(); }
+		VkExtent2D GetSwapchainExtent() const { return swapchain->getSwapChainExtent(); }
+		const PresentSettings& GetPresentSettings() const { return Present; }
+		VkPresentModeKHR GetPresentMode() const { return swapchain->getPresentMode(); }
+		// Recreates the swapchain at the start of the next frame. While the LowLatency policy is active, frames
+		// in flight are also limited to 1; the previous count, or one requested since, comes back when another
+		// policy is chosen.
+		void SetPresentSettings(const PresentSettings& present) { RequestedPresent = present; }
+		// Use instead of FrameResources::RequestFramesInFlight. While LowLatency is active the count is kept
+		// for when it ends.
+		void RequestFramesInFlight(uint32_t count);
+		PresentLatencyStats GetPresentLatency(PresentPolicy policy) const;
+		bool IsPresentLatencyApproximate() const { return !Frames.UsesTimeline(); }
 		bool IsFrameInProgress() const { return IsFrameStarted; }
 		VkCommandBuffer GetCurrentCB() const 
 		{
@@ -28,6 +64,8 @@ namespace vlkn {
 			return CommandBuffers[CurrentFrameIndex];
 		}
 
+		uint32_t GetFramesInFlight() const { return Frames.GetFramesInFlight(); }
+
 		int GetFrameIndex() const {
 			assert(IsFrameStarted && "Cannot get frame index when frame is not in progress");
 			return CurrentFrameIndex;
@@ -35,23 +73,53 @@ namespace vlkn {
 		
 		VkCommandBuffer BeginFrame();
 		void EndFrame();
-		void BeginSwapchainRenderPass(VkCommandBuffer CommandBuffer);
+		// With secondaryContents the pass may only be filled by executing secondary command buffers, which
+		// then have to set the viewport and scissor themselves.
+		void BeginSwapchainRenderPass(VkCommandBuffer CommandBuffer, bool secondaryContents = false);
 		void EndSwapchainRenderPass(VkCommandBuffer CommandBuffer);
 
 
 	private:
 		void CreateCommandBuffers();
 		void FreeCommandBuffers();
+		void ResizeFrames(uint32_t frameCount);
 		void RecreateSwapchain();
+		void ApplyPresentSettings();
+		void RecordCompletedLatencies();
+		void LatencyLoop();
+		void BeginSwapchainRenderPassObject(VkCommandBuffer CommandBuffer, bool secondaryContents);
+		void BeginSwapchainRendering(VkCommandBuffer CommandBuffer, bool secondaryContents);
 
 		Window& window;
 		VulkanDevice& Device;
+		FrameResources& Frames;
 		std::unique_ptr<Swapchain> swapchain;
+		bool UseDynamicRendering;
 		std::vector<VkCommandBuffer> CommandBuffers;
+
+		struct PendingLatency {
+			uint64_t Frame;
+			std::chrono::high_resolution_clock::time_point InputTime;
+			PresentPolicy Policy;
+		};
+
+		PresentSettings Present;
+		PresentSettings RequestedPresent;
+		uint32_t FramesBeforeLowLatency = 0;
+		void RecordLatency(const PendingLatency& Pending, std::chrono::high_resolution_clock::time_point CompletedTime);
+
+		// Guards the pending samples and the stats, which the latency thread updates with a frame timeline.
+		mutable std::mutex LatencyMutex;
+		std::condition_variable LatencyAvailable;
+		bool StopLatencyThread = false;
+		std::deque<PendingLatency> PendingLatencies;
+		std::array<PresentLatencyStats, PRESENT_POLICY_COUNT> Latency{};
+		std::thread LatencyThread;
 		
 		uint32_t CurrentImgIndex;
 		int CurrentFrameIndex{0};
 		bool IsFrameStarted{false};
+		FrameResources::Registration FramesRegistration;
 		
 	};
 }
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "ShaderModuleCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vlkn {
+
+	namespace {
+		// Read-only view of a whole file, unmapped on destruction.
+		class MappedFile {
+		public:
+			MappedFile(const std::string& FilePath)
+			{
+#ifdef _WIN32
+				File = CreateFileA(FilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (File == INVALID_HANDLE_VALUE)
+				{
+					throw std::runtime_error("Failed to Open File: " + FilePath);
+				}
+
+				LARGE_INTEGER FileSize;
+				GetFileSizeEx(File, &FileSize);
+				Size = static_cast<size_t>(FileSize.QuadPart);
+				if (Size == 0)
+				{
+					return;
+				}
+
+				Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				Data = Mapping != nullptr ? MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+				Fd = open(FilePath.c_str(), O_RDONLY);
+				if (Fd < 0)
+				{
+					throw std::runtime_error("Failed to Open File: " + FilePath);
+				}
+
+				struct stat FileStat;
+				fstat(Fd, &FileStat);
+				Size = static_cast<size_t>(FileStat.st_size);
+				if (Size == 0)
+				{
+					return;
+				}
+
+				Data = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, Fd, 0);
+				if (Data == MAP_FAILED)
+				{
+					Data = nullptr;
+				}
+#endif
+				if (Data == nullptr)
+				{
+					Close();
+					throw std::runtime_error("Failed to Map File: " + FilePath);
+				}
+			}
+
+			~MappedFile() { Close(); }
+
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			const unsigned char* GetData() const { return static_cast<const unsigned char*>(Data); }
+			size_t GetSize() const { return Size; }
+
+		private:
+			void Close()
+			{
+#ifdef _WIN32
+				if (Data != nullptr) UnmapViewOfFile(Data);
+				if (Mapping != nullptr) CloseHandle(Mapping);
+				if (File != INVALID_HANDLE_VALUE) CloseHandle(File);
+				Mapping = nullptr;
+				File = INVALID_HANDLE_VALUE;
+#else
+				if (Data != nullptr) munmap(Data, Size);
+				if (Fd >= 0) close(Fd);
+				Fd = -1;
+#endif
+				Data = nullptr;
+			}
+
+#ifdef _WIN32
+			HANDLE File = INVALID_HANDLE_VALUE;
+			HANDLE Mapping = nullptr;
+			const void* Data = nullptr;
+#else
+			int Fd = -1;
+			void* Data = nullptr;
+#endif
+			size_t Size = 0;
+		};
+	}
+
+	ShaderModuleCache::Module::Module(VkDevice device, std::vector<uint32_t> code, uint64_t hash, bool createModule)
+		: Device{ device }, Code{ std::move(code) }, Hash{ hash }
+	{
+		CreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		CreateInfo.codeSize = Code.size() * sizeof(uint32_t);
+		CreateInfo.pCode = Code.data();
+
+		if (createModule && vkCreateShaderModule(Device, &CreateInfo, nullptr, &Handle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Shader Module");
+		}
+	}
+
+	ShaderModuleCache::Module::~Module()
+	{
+		if (Handle != VK_NULL_HANDLE)
+		{
+			vkDestroyShaderModule(Device, Handle, nullptr);
+		}
+	}
+
+	void ShaderModuleCache::Module::FillStage(VkPipelineShaderStageCreateInfo& Stage) const
+	{
+		Stage.module = Handle;
+		Stage.pNext = Handle == VK_NULL_HANDLE ? &CreateInfo : nullptr;
+	}
+
+	ShaderModuleCache::ShaderModuleCache(VulkanDevice& device)
+		: Device{ device }, CreateModuleObjects{ !device.isExtensionEnabled(VK_KHR_MAINTENANCE_5_EXTENSION_NAME) }
+	{
+	}
+
+	std::shared_ptr<const ShaderModuleCache::Module> ShaderModuleCache::Load(const std::string& FilePath)
+	{
+		MappedFile File{ FilePath };
+		if (File.GetSize() == 0 || File.GetSize() % sizeof(uint32_t) != 0)
+		{
+			throw std::runtime_error("Invalid SPIR-V File: " + FilePath);
+		}
+		return LoadCode(File.GetData(), File.GetSize());
+	}
+
+	std::shared_ptr<const ShaderModuleCache::Module> ShaderModuleCache::Load(std::span<const uint32_t> Code)
+	{
+		if (Code.empty())
+		{
+			throw std::runtime_error("Empty SPIR-V Code");
+		}
+		return LoadCode(reinterpret_cast<const unsigned char*>(Code.data()), Code.size_bytes());
+	}
+
+	std::shared_ptr<const ShaderModuleCache::Module> ShaderModuleCache::LoadCode(const unsigned char* data, size_t size)
+	{
+		uint64_t Hash = HashCode(data, size);
+
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		CacheStats.Requests++;
+
+		auto& Bucket = Modules[Hash];
+		Bucket.erase(std::remove_if(Bucket.begin(), Bucket.end(),
+			[](const std::weak_ptr<Module>& Entry) { return Entry.expired(); }), Bucket.end());
+
+		// Compare the bytes as well, a hash match alone is not proof of identical code.
+		for (const auto& Entry : Bucket)
+		{
+			auto Existing = Entry.lock();
+			if (Existing && Existing->GetCode().size() * sizeof(uint32_t) == size &&
+				memcmp(Existing->GetCode().data(), data, size) == 0)
+			{
+				CacheStats.ModulesShared++;
+				return Existing;
+			}
+		}
+
+		// SPIR-V must be 4-byte aligned for vkCreateShaderModule, so the code is copied out of the mapping.
+		std::vector<uint32_t> Code(size / sizeof(uint32_t));
+		memcpy(Code.data(), data, size);
+
+		auto Created = std::make_shared<Module>(Device.device(), std::move(Code), Hash, CreateModuleObjects);
+		Bucket.push_back(Created);
+		CacheStats.ModulesCreated++;
+		return Created;
+	}
+
+	ShaderModuleCache::Stats ShaderModuleCache::GetStats() const
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		Stats Result = CacheStats;
+		Result.LiveModules = 0;
+		for (const auto& [Hash, Bucket] : Modules)
+		{
+			Result.LiveModules += static_cast<uint32_t>(std::count_if(Bucket.begin(), Bucket.end(),
+				[](const std::weak_ptr<Module>& Entry) { return !Entry.expired(); }));
+		}
+		return Result;
+	}
+
+	// 64-bit FNV-1a.
+	uint64_t ShaderModuleCache::HashCode(const unsigned char* data, size_t size)
+	{
+		uint64_t Hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; i++)
+		{
+			Hash ^= data[i];
+			Hash *= 1099511628211ull;
+		}
+		return Hash;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vlkn {
+
+	// Shares shader modules between pipelines. Files are memory-mapped and keyed by a hash of their SPIR-V,
+	// so the same code loaded through different paths (or by several pipelines) becomes one module. Modules
+	// are refcounted through shared_ptr and destroyed when the last pipeline using them goes away.
+	class ShaderModuleCache {
+	public:
+		class Module {
+		public:
+			Module(VkDevice device, std::vector<uint32_t> code, uint64_t hash, bool createModule);
+			~Module();
+
+			Module(const Module&) = delete;
+			Module& operator=(const Module&) = delete;
+
+			/**
+		 * Points Stage at this shader. Without maintenance5 that is the VkShaderModule; with it no module
+		 * object exists and the VkShaderModuleCreateInfo is chained into Stage.pNext instead.
+		 *
+		 * @note The stage may only be used while this Module is alive.
+		 */
+			void FillStage(VkPipelineShaderStageCreateInfo& Stage) const;
+
+			VkShaderModule GetHandle() const { return Handle; }
+			const std::vector<uint32_t>& GetCode() const { return Code; }
+			uint64_t GetHash() const { return Hash; }
+
+		private:
+			VkDevice Device;
+			std::vector<uint32_t> Code;
+			uint64_t Hash;
+			VkShaderModuleCreateInfo CreateInfo{};
+			VkShaderModule Handle = VK_NULL_HANDLE;
+		};
+
+		struct Stats {
+			uint32_t Requests = 0;
+			uint32_t ModulesCreated = 0;
+			uint32_t ModulesShared = 0;
+			uint32_t LiveModules = 0;
+		};
+
+		ShaderModuleCache(VulkanDevice& device);
+
+		ShaderModuleCache(const ShaderModuleCache&) = delete;
+		ShaderModuleCache& operator=(const ShaderModuleCache&) = delete;
+
+		std::shared_ptr<const Module> Load(const std::string& FilePath);
+		// For SPIR-V already in memory, such as the shaders embedded at build time.
+		std::shared_ptr<const Module> Load(std::span<const uint32_t> Code);
+
+		bool UsesModuleObjects() const { return CreateModuleObjects; }
+		Stats GetStats() const;
+
+	private:
+		static uint64_t HashCode(const unsigned char* data, size_t size);
+		std::shared_ptr<const Module> LoadCode(const unsigned char* data, size_t size);
+
+		VulkanDevice& Device;
+		bool CreateModuleObjects;
+		// Weak so the cache never keeps a module alive; entries are pruned as they expire.
+		std::unordered_map<uint64_t, std::vector<std::weak_ptr<Module>>> Modules;
+		Stats CacheStats{};
+		mutable std::mutex Mutex;
+	};
+}
@@ -1,4 +1,7 @@
 #include "ShaderSystem.hpp"
+#include "VulkanLayoutCache.hpp"
+#include "EmbeddedShaders.hpp"
+#include "Utils.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -6,8 +9,12 @@
 #include <glm/gtc/constants.hpp>
 
 #include <stdexcept>
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <filesystem>
+#include <chrono>
+#include <iostream>
 
 namespace vlkn {
 	struct SimplePushConstantData {
@@ -15,22 +22,149 @@ namespace vlkn {
 		glm::mat4 NormalMatrix{ 1.0f };
 	};
 
+	// Matches ObjectData in shader_indirect.vert (std430).
+	struct IndirectObjectData {
+		glm::mat4 ModelMatrix{ 1.0f };
+		glm::mat4 NormalMatrix{ 1.0f };
+	};
+
+	// Vertex binding 1 of shader_instanced.vert, one entry per instance.
+	struct InstanceData {
+		glm::mat4 ModelMatrix{ 1.0f };
+		glm::mat4 NormalMatrix{ 1.0f };
+
+		static VkVertexInputBindingDescription GetBindingDescription()
+		{
+			return { 1, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE };
+		}
+
+		static void AppendAttributeDescriptions(std::vector<VkVertexInputAttributeDescription>& AttrDescriptions)
+		{
+			// A mat4 attribute takes one location per column.
+			for (uint32_t Column = 0; Column < 4; Column++)
+			{
+				AttrDescriptions.push_back({ 4 + Column, 1, VK_FORMAT_R32G32B32A32_SFLOAT,
+					static_cast<uint32_t>(offsetof(InstanceData, ModelMatrix) + Column * sizeof(glm::vec4)) });
+				AttrDescriptions.push_back({ 8 + Column, 1, VK_FORMAT_R32G32B32A32_SFLOAT,
+					static_cast<uint32_t>(offsetof(InstanceData, NormalMatrix) + Column * sizeof(glm::vec4)) });
+			}
+		}
+	};
+
 }
-vlkn::ShaderSystem::ShaderSystem(VulkanDevice& Device, VkRenderPass RenderPass, VkDescriptorSetLayout globalSetLayout)
+vlkn::ShaderSystem::ShaderSystem(VulkanDevice& Device, const RenderTargetInfo& Target, VkDescriptorSetLayout globalSetLayout, PipelineRegistry& Registry,
+	JobSystem& Jobs, FrameResources& Frames, bool useDynamicRenderState)
 	:
-	Device{Device}
+	Device{Device}, Registry{Registry}, Jobs{Jobs}, Frames{Frames}, RenderTarget{Target},
+	DynamicRenderState{useDynamicRenderState && Device.extendedDynamicStateEnabled()}, StateRecorder{Device}
 {
-	CreatePipelineLayout(globalSetLayout);
-	CreatePipeline(RenderPass);
+	if (useDynamicRenderState && !DynamicRenderState)
+	{
+		std::cout << "Extended dynamic state not supported on this device, render state stays baked into pipelines\n";
+	}
+
+	CreatePipelineLayouts(globalSetLayout);
+	CreatePipelines();
+	CreateIndirectResources();
+	CreateInstanceResources();
+	FramesRegistration = Frames.Register([this](uint32_t frameCount) { ResizeFrames(frameCount); });
 }
 
+// Pipeline layouts belong to the device's layout cache.
 vlkn::ShaderSystem::~ShaderSystem()
 {
-	vkDestroyPipelineLayout(Device.device(), PipelineLayout, nullptr);
+	if (ReloadInSetup)
+	{
+		try
+		{
+			Jobs.Wait(ReloadInSetup->Done);
+		}
+		catch (const std::exception&)
+		{
+		}
+	}
+}
+
+uint64_t vlkn::ShaderSystem::GetRenderStateCommandCount() const
+{
+	uint64_t Count = StateRecorder.GetCommandCount();
+	for (const auto& States : ThreadStateRecorders)
+	{
+		Count += States.GetCommandCount();
+	}
+	return Count;
+}
+
+void vlkn::ShaderSystem::SetRecordingThreads(uint32_t threadCount)
+{
+	ThreadStateRecorders.clear();
+	Recorder.reset();
+	if (threadCount == 1)
+	{
+		return;
+	}
+
+	Recorder = std::make_unique<ParallelCommandRecorder>(Device, Jobs, Frames, threadCount);
+	ThreadStateRecorders.assign(Jobs.GetThreadCount(), RenderStateRecorder{ Device });
+}
+
+vlkn::ShaderSystem::RecordingBenchmarkResult vlkn::ShaderSystem::BenchmarkRecording(FrameInfo& frameInfo)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	constexpr int RUNS = 3;
+
+	// Nothing is submitted, so models that are still uploading can be recorded too.
+	PrepareDrawItems(frameInfo, true);
+
+	std::unique_ptr<ParallelCommandRecorder> BenchRecorder;
+	ParallelCommandRecorder* Bench = Recorder.get();
+	if (Bench == nullptr)
+	{
+		BenchRecorder = std::make_unique<ParallelCommandRecorder>(Device, Jobs, Frames);
+		Bench = BenchRecorder.get();
+	}
+	std::vector<RenderStateRecorder> States(Jobs.GetThreadCount(), RenderStateRecorder{ Device });
+
+	auto TimeRuns = [&](uint32_t threadLimit) {
+		double Best = 0.0;
+		for (int Run = 0; Run < RUNS; Run++)
+		{
+			Bench->BeginFrame(frameInfo.FrameIndex);
+			auto Start = Clock::now();
+			Bench->RecordSecondaries(RenderTarget, frameInfo.Extent, DrawItems.size(),
+				[&](VkCommandBuffer CommandBuffer, uint32_t Thread, size_t Begin, size_t End) {
+					RecordDirectRange(frameInfo, CommandBuffer, States[Thread], Begin, End);
+				}, threadLimit);
+			double Ms = std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+			Best = Run == 0 ? Ms : std::min(Best, Ms);
+		}
+		return Best;
+	};
+
+	RecordingBenchmarkResult Result{};
+	Result.ObjectCount = DrawItems.size();
+	Result.ThreadCount = Bench->GetMaxRanges();
+	Result.SingleThreadMs = TimeRuns(1);
+	Result.ParallelMs = TimeRuns(0);
+	Bench->BeginFrame(frameInfo.FrameIndex);
+	FramePrepared = false;
+	return Result;
+}
+
+void vlkn::ShaderSystem::SetDrawPath(DrawPath path)
+{
+	if (path == DrawPath::Indirect && !SupportsIndirect())
+	{
+		std::cout << "Indirect draw path not supported on this device, using direct draws\n";
+		path = DrawPath::Direct;
+	}
+	Path = path;
 }
 
-void vlkn::ShaderSystem::CreatePipelineLayout(VkDescriptorSetLayout globalSetLayout)
+// The indirect path needs drawIndirectFirstInstance, since each draw's firstInstance is its object index.
+void vlkn::ShaderSystem::CreatePipelineLayouts(VkDescriptorSetLayout globalSetLayout)
 {
+	// shader.frag declares the push constant block, so every layout carries the range.
 	VkPushConstantRange PushConstRange{};
 	PushConstRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 	PushConstRange.offset = 0;
@@ -38,56 +172,661 @@ void vlkn::ShaderSystem::CreatePipelineLayout(VkDescriptorSetLayout globalSetLay
 
 	std::vector<VkDescriptorSetLayout> DescriptorSetLayouts{ globalSetLayout };
 
-	VkPipelineLayoutCreateInfo PipelineLayoutInfo{};
-	PipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	PipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(DescriptorSetLayouts.size());
-	PipelineLayoutInfo.pSetLayouts = DescriptorSetLayouts.data();
-	PipelineLayoutInfo.pushConstantRangeCount = 1;
-	PipelineLayoutInfo.pPushConstantRanges = &PushConstRange;
+	PipelineLayout = Device.layoutCache().GetPipelineLayout(DescriptorSetLayouts, { PushConstRange });
+
+	if (!Device.enabledFeatures().drawIndirectFirstInstance)
+	{
+		return;
+	}
+
+	ObjectSetLayout = VulkanDescriptorSetLayout::Builder(Device)
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT).Build();
+
+	DescriptorSetLayouts.push_back(ObjectSetLayout->GetDescriptorSetLayout());
+	IndirectPipelineLayout = Device.layoutCache().GetPipelineLayout(DescriptorSetLayouts, { PushConstRange });
+}
+
+bool vlkn::ShaderSystem::IsRecompiled(const std::string& FilePath) const
+{
+	// Compared as paths, as the watcher builds them with the platform's separator.
+	return std::any_of(RecompiledShaders.begin(), RecompiledShaders.end(),
+		[&](const std::string& Recompiled) { return std::filesystem::path{ Recompiled } == std::filesystem::path{ FilePath }; });
+}
+
+vlkn::PipelineCompiler::Request vlkn::ShaderSystem::MakePipelineRequest(const RenderTargetInfo& Target, VkPipelineLayout Layout, const std::string& VertFilePath) const
+{
+	assert(Layout != nullptr && "Cannot create pipeline before pipeline layout");
 
-	if (vkCreatePipelineLayout(Device.device(), &PipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS)
+	PipelineCompiler::Request Req{ VertFilePath, "shaders/shader.frag.spv", std::make_unique<PipelineConfigInfo>() };
+	if (!IsRecompiled(Req.VertFilePath))
+	{
+		Req.VertCode = FindEmbeddedShader(Req.VertFilePath);
+	}
+	if (!IsRecompiled(Req.FragFilePath))
+	{
+		Req.FragCode = FindEmbeddedShader(Req.FragFilePath);
+	}
+	Pipeline::DefaultPipelineConfigInfo(*Req.Config);
+	Target.Apply(*Req.Config);
+	Req.Config->pipelineLayout = Layout;
+	if (DynamicRenderState)
 	{
-		throw std::runtime_error("Failed to Create Pipeline Layout");
+		Pipeline::EnableDynamicRenderState(*Req.Config, Device.dynamicPolygonModeEnabled());
 	}
+	return Req;
 }
 
-void vlkn::ShaderSystem::CreatePipeline(VkRenderPass RenderPass)
+vlkn::PipelineCompiler::Request vlkn::ShaderSystem::MakeDirectRequest(const RenderTargetInfo& Target) const
 {
-	assert(PipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
-	PipelineConfigInfo PipelineConfig{};
-	Pipeline::DefaultPipelineConfigInfo(
-		PipelineConfig);
+	return MakePipelineRequest(Target, PipelineLayout, "shaders/shader.vert.spv");
+}
 
-	PipelineConfig.renderPass = RenderPass;
-	PipelineConfig.pipelineLayout = PipelineLayout;
+vlkn::PipelineCompiler::Request vlkn::ShaderSystem::MakeInstancedRequest(const RenderTargetInfo& Target) const
+{
+	auto Req = MakePipelineRequest(Target, PipelineLayout, "shaders/shader_instanced.vert.spv");
+	Req.Config->bindingDescriptions.push_back(InstanceData::GetBindingDescription());
+	InstanceData::AppendAttributeDescriptions(Req.Config->attributeDescriptions);
+	return Req;
+}
 
-	pipeline = std::make_unique<Pipeline>(Device, "shaders/shader.vert.spv", "shaders/shader.frag.spv", PipelineConfig);
+std::vector<vlkn::PipelineCompiler::Request> vlkn::ShaderSystem::GetPipelineRequests(const RenderTargetInfo& Target) const
+{
+	std::vector<PipelineCompiler::Request> Requests;
+	Requests.push_back(MakeDirectRequest(Target));
+	Requests.push_back(MakeInstancedRequest(Target));
 
+	if (IndirectPipelineLayout != VK_NULL_HANDLE)
+	{
+		Requests.push_back(MakePipelineRequest(Target, IndirectPipelineLayout, "shaders/shader_indirect.vert.spv"));
+	}
+	return Requests;
 }
 
+// Starts building a complete set of pipelines without waiting for any of them.
+vlkn::ShaderSystem::PipelineSet vlkn::ShaderSystem::RequestPipelineSet(const std::vector<ShaderVariantKey>& DirectKeys,
+	const std::vector<ShaderVariantKey>& InstancedKeys)
+{
+	PipelineSet Set{};
+	Set.DirectVariants = std::make_unique<ShaderVariantRegistry>(Registry, [this]() { return MakeDirectRequest(RenderTarget); });
+	Set.InstancedVariants = std::make_unique<ShaderVariantRegistry>(Registry, [this]() { return MakeInstancedRequest(RenderTarget); });
+	Set.DirectVariants->Request(DirectKeys);
+	Set.InstancedVariants->Request(InstancedKeys);
+
+	if (IndirectPipelineLayout != VK_NULL_HANDLE)
+	{
+		Set.IndirectBuild = Registry.Request(MakePipelineRequest(RenderTarget, IndirectPipelineLayout, "shaders/shader_indirect.vert.spv"));
+	}
+	return Set;
+}
+
+// The default variants and the indirect pipeline are compiled concurrently; construction blocks until they are done.
+void vlkn::ShaderSystem::CreatePipelines()
+{
+	PipelineSet Set = RequestPipelineSet({ ShaderVariantKey{} }, { ShaderVariantKey{} });
+
+	Set.DirectVariants->Prewarm({ ShaderVariantKey{} });
+	Set.InstancedVariants->Prewarm({ ShaderVariantKey{} });
+	DirectVariants = std::move(Set.DirectVariants);
+	InstancedVariants = std::move(Set.InstancedVariants);
+
+	if (Set.IndirectBuild.valid())
+	{
+		IndirectPipeline = Set.IndirectBuild.get();
+	}
+}
+
+// A newer request replaces one still in flight; the abandoned builds are pruned from the registry later.
+void vlkn::ShaderSystem::RequestReload(const std::vector<std::string>& recompiled)
+{
+	for (const auto& Path : recompiled)
+	{
+		std::cout << "Shader hot reload: " << Path << " changed\n";
+		QueuedShaders.push_back(Path);
+	}
+	StartReload();
+}
+
+// Reading the .spv files and creating their shader modules happens on the job system; ApplyPendingReload
+// picks up the result, or the error.
+void vlkn::ShaderSystem::StartReload()
+{
+	if (ReloadInSetup)
+	{
+		// Started again once the current setup has finished.
+		return;
+	}
+	// The embedded SPIR-V is what the executable was built with; edited shaders only exist on disk.
+	for (auto& Path : QueuedShaders)
+	{
+		if (!IsRecompiled(Path))
+		{
+			RecompiledShaders.push_back(std::move(Path));
+		}
+	}
+	QueuedShaders.clear();
+
+	ReloadInSetup = std::make_unique<ReloadSetup>();
+	Jobs.Submit([this, Setup = ReloadInSetup.get(), DirectKeys = DirectVariants->GetKeys(),
+		InstancedKeys = InstancedVariants->GetKeys()]() {
+			Setup->Set = RequestPipelineSet(DirectKeys, InstancedKeys);
+		}, ReloadInSetup->Done);
+}
+
+void vlkn::ShaderSystem::ApplyPendingReload()
+{
+	bool Released = false;
+	const uint64_t CompletedFrame = Frames.GetCompletedFrame();
+	for (auto It = RetiredSets.begin(); It != RetiredSets.end();)
+	{
+		if (It->LastUsedFrame <= CompletedFrame)
+		{
+			It = RetiredSets.erase(It);
+			Released = true;
+		}
+		else
+		{
+			++It;
+		}
+	}
+	if (Released)
+	{
+		Registry.Prune();
+	}
+
+	if (ReloadInSetup && ReloadInSetup->Done.IsDone())
+	{
+		try
+		{
+			Jobs.Wait(ReloadInSetup->Done);
+			PendingReload = std::make_unique<PipelineSet>(std::move(ReloadInSetup->Set));
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "Shader hot reload failed: " << e.what() << ", keeping the current pipelines\n";
+			Registry.Prune();
+		}
+		ReloadInSetup.reset();
+	}
+	if (!QueuedShaders.empty())
+	{
+		StartReload();
+	}
+
+	if (!PendingReload || !PendingReload->DirectVariants->IsReady() || !PendingReload->InstancedVariants->IsReady() ||
+		(PendingReload->IndirectBuild.valid() &&
+			PendingReload->IndirectBuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready))
+	{
+		return;
+	}
+
+	// Everything has finished compiling, so none of these block; they only surface build errors.
+	try
+	{
+		for (const auto& Key : PendingReload->DirectVariants->GetKeys())
+		{
+			PendingReload->DirectVariants->Get(Key);
+		}
+		for (const auto& Key : PendingReload->InstancedVariants->GetKeys())
+		{
+			PendingReload->InstancedVariants->Get(Key);
+		}
+		if (PendingReload->IndirectBuild.valid())
+		{
+			PendingReload->IndirectPipeline = PendingReload->IndirectBuild.get();
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "Shader hot reload failed: " << e.what() << ", keeping the current pipelines\n";
+		PendingReload.reset();
+		Registry.Prune();
+		return;
+	}
+
+	// Frames still in flight may reference the old pipelines, so they are kept until those frames retire.
+	PipelineSet Old{};
+	Old.DirectVariants = std::move(DirectVariants);
+	Old.InstancedVariants = std::move(InstancedVariants);
+	Old.IndirectPipeline = std::move(IndirectPipeline);
+	Old.LastUsedFrame = Frames.GetCurrentFrame() - 1;
+	RetiredSets.push_back(std::move(Old));
+
+	DirectVariants = std::move(PendingReload->DirectVariants);
+	InstancedVariants = std::move(PendingReload->InstancedVariants);
+	IndirectPipeline = std::move(PendingReload->IndirectPipeline);
+	PendingReload.reset();
+
+	std::cout << "Shader hot reload: pipelines swapped\n";
+}
+
+void vlkn::ShaderSystem::PrewarmVariants(const GameObject::Map& GameObjects)
+{
+	std::vector<ShaderVariantKey> Keys;
+	for (const auto& kv : GameObjects)
+	{
+		if (kv.second.Model == nullptr) continue;
+
+		ShaderVariantKey Key = VariantFor(*kv.second.Model);
+		if (std::find(Keys.begin(), Keys.end(), Key) == Keys.end())
+		{
+			Keys.push_back(Key);
+		}
+	}
+
+	DirectVariants->Prewarm(Keys);
+	InstancedVariants->Prewarm(Keys);
+}
+
+vlkn::ShaderVariantKey vlkn::ShaderSystem::VariantFor(const Model& model)
+{
+	ShaderVariantKey Key{};
+	Key.HasVertexColor = model.HasVertexColor();
+	Key.HasNormals = model.HasNormals();
+	return Key;
+}
+
+void vlkn::ShaderSystem::BindVariant(ShaderVariantRegistry& Variants, const Model& model, VkCommandBuffer CommandBuffer, Pipeline*& Bound)
+{
+	BindPipeline(Variants.Get(VariantFor(model)), CommandBuffer, Bound);
+}
+
+void vlkn::ShaderSystem::BindPipeline(Pipeline& Variant, VkCommandBuffer CommandBuffer, Pipeline*& Bound)
+{
+	if (&Variant != Bound)
+	{
+		Variant.bind(CommandBuffer);
+		Bound = &Variant;
+	}
+}
+
+void vlkn::ShaderSystem::CreateInstanceResources()
+{
+	ResizeInstanceBuffers(Frames.GetFramesInFlight());
+}
+
+void vlkn::ShaderSystem::ResizeInstanceBuffers(uint32_t frameCount)
+{
+	size_t Previous = InstanceBuffers.size();
+	InstanceBuffers.resize(frameCount);
+	for (size_t i = Previous; i < InstanceBuffers.size(); i++)
+	{
+		EnsureInstanceCapacity(static_cast<int>(i), 256);
+	}
+}
+
+void vlkn::ShaderSystem::ResizeFrames(uint32_t frameCount)
+{
+	ResizeIndirectFrames(frameCount);
+	ResizeInstanceBuffers(frameCount);
+
+	// Nothing is in flight, so retired pipelines can go now.
+	if (!RetiredSets.empty())
+	{
+		RetiredSets.clear();
+		Registry.Prune();
+	}
+}
+
+void vlkn::ShaderSystem::EnsureInstanceCapacity(int frameIndex, uint32_t instanceCount)
+{
+	auto& Buffer = InstanceBuffers[frameIndex];
+	uint32_t Capacity = Buffer ? Buffer->GetInstanceCount() : 0;
+	if (instanceCount <= Capacity)
+	{
+		return;
+	}
+
+	Buffer = std::make_unique<VulkanBufferObjects>(Device, sizeof(InstanceData), std::max(instanceCount, Capacity * 2),
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	Buffer->Map();
+}
+
+void vlkn::ShaderSystem::CreateIndirectResources()
+{
+	if (!IndirectPipeline)
+	{
+		return;
+	}
+
+	ResizeIndirectFrames(Frames.GetFramesInFlight());
+
+	// The count is read per chunk of up to maxDrawIndirectCount draws, which is 1 without multiDrawIndirect.
+	if (Device.isExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) && Device.enabledFeatures().multiDrawIndirect)
+	{
+		CmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+			vkGetDeviceProcAddr(Device.device(), "vkCmdDrawIndexedIndirectCountKHR"));
+	}
+}
+
+void vlkn::ShaderSystem::ResizeIndirectFrames(uint32_t frameCount)
+{
+	if (!IndirectPipeline)
+	{
+		return;
+	}
+
+	size_t Previous = IndirectFrames.size();
+	IndirectFrames.resize(frameCount);
+	for (size_t i = Previous; i < IndirectFrames.size(); i++)
+	{
+		EnsureIndirectCapacity(IndirectFrames[i], 64);
+	}
+}
+
+// Only called for the frame being recorded, whose previous submission has already been waited on.
+void vlkn::ShaderSystem::EnsureIndirectCapacity(IndirectFrame& frame, uint32_t drawCount)
+{
+	if (drawCount <= frame.Capacity)
+	{
+		return;
+	}
+
+	frame.Capacity = std::max(drawCount, frame.Capacity * 2);
+
+	frame.Commands = std::make_unique<VulkanBufferObjects>(Device, sizeof(VkDrawIndexedIndirectCommand), frame.Capacity,
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	frame.Commands->Map();
+
+	frame.Objects = std::make_unique<VulkanBufferObjects>(Device, sizeof(IndirectObjectData), frame.Capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	frame.Objects->Map();
+
+	// One count per chunk of at most maxDrawIndirectCount draws.
+	const uint32_t MaxDraws = Device.properties.limits.maxDrawIndirectCount;
+	frame.DrawCount = std::make_unique<VulkanBufferObjects>(Device, sizeof(uint32_t), (frame.Capacity - 1) / MaxDraws + 1,
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	frame.DrawCount->Map();
+}
+
+
+void vlkn::ShaderSystem::PrepareFrame(FrameInfo& frameInfo)
+{
+	PrepareDrawItems(frameInfo, false);
+	FramePrepared = true;
+}
 
 void vlkn::ShaderSystem::RenderGameObjects(FrameInfo & frameInfo)
 {
-	pipeline->bind(frameInfo.CommandBuffer);\
+	if (!FramePrepared)
+	{
+		PrepareDrawItems(frameInfo, false);
+	}
+	FramePrepared = false;
 
-		vkCmdBindDescriptorSets(
-			frameInfo.CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout,
-			0, 1, &frameInfo.GlobalDescriptorSet, 0, nullptr);
+	switch (Path)
+	{
+	case DrawPath::Instanced:
+		RenderInstanced(frameInfo);
+		break;
+	case DrawPath::Indirect:
+		RenderIndirect(frameInfo);
+		break;
+	default:
+		RenderDirect(frameInfo);
+		break;
+	}
+}
 
+void vlkn::ShaderSystem::RenderDirect(FrameInfo& frameInfo)
+{
+	if (Recorder == nullptr)
+	{
+		RecordDirectRange(frameInfo, frameInfo.CommandBuffer, StateRecorder, 0, DrawItems.size());
+		return;
+	}
+
+	Recorder->BeginFrame(frameInfo.FrameIndex);
+	Recorder->Record(frameInfo.CommandBuffer, RenderTarget, frameInfo.Extent, DrawItems.size(),
+		[&](VkCommandBuffer CommandBuffer, uint32_t Thread, size_t Begin, size_t End) {
+			RecordDirectRange(frameInfo, CommandBuffer, ThreadStateRecorders[Thread], Begin, End);
+		});
+}
+
+// Model::IsReady polls the upload fences, so the objects are gathered on one thread; only the matrices
+// are computed on the job system. Each distinct variant is looked up in the registry once per frame.
+void vlkn::ShaderSystem::PrepareDrawItems(FrameInfo& frameInfo, bool includeUnready)
+{
+	DrawItems.clear();
+	std::vector<std::pair<ShaderVariantKey, Pipeline*>> Resolved;
 	for (auto& kv : frameInfo.GameObjects)
 	{
 		auto& Obj = kv.second;
-		
-		if (Obj.Model == nullptr) continue;
+		if (Obj.Model == nullptr || (!includeUnready && !Obj.Model->IsReady())) continue;
 
-		SimplePushConstantData Push{};
+		ShaderVariantKey Key = VariantFor(*Obj.Model);
+		auto It = std::find_if(Resolved.begin(), Resolved.end(), [&](const auto& Entry) { return Entry.first == Key; });
+		if (It == Resolved.end())
+		{
+			It = Resolved.emplace(Resolved.end(), Key, &DirectVariants->Get(Key));
+		}
+		DrawItems.push_back({ &Obj, It->second });
+	}
+
+	Jobs.ParallelFor(DrawItems.size(), 1024, [this](size_t Begin, size_t End) {
+		for (size_t i = Begin; i < End; i++)
+		{
+			auto& Item = DrawItems[i];
+			Item.ModelMatrix = Item.Object->Transform.Mat4();
+			Item.NormalMatrix = Item.Object->Transform.NormalMatrix();
+		}
+	});
+}
+
+// Every variant shares PipelineLayout, so the global set stays bound across pipeline switches. Called
+// concurrently for disjoint ranges when recording on several threads.
+void vlkn::ShaderSystem::RecordDirectRange(FrameInfo& frameInfo, VkCommandBuffer CommandBuffer, RenderStateRecorder& States,
+	size_t Begin, size_t End)
+{
+	Pipeline* Bound = nullptr;
+	States.Reset();
+	BindGlobalSet(frameInfo, CommandBuffer, PipelineLayout);
 
-		Push.ModelMatrix = Obj.Transform.Mat4();
-		Push.NormalMatrix = Obj.Transform.NormalMatrix();
+	// Every model lives in the shared geometry pool, so one bind covers the whole frame.
+	frameInfo.Geometry.Bind(CommandBuffer);
 
-		vkCmdPushConstants(frameInfo.CommandBuffer, PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &Push);
-		Obj.Model->Bind(frameInfo.CommandBuffer);
-		Obj.Model->Draw(frameInfo.CommandBuffer);
+	for (size_t i = Begin; i < End; i++)
+	{
+		const auto& Item = DrawItems[i];
+		BindPipeline(*Item.DirectVariant, CommandBuffer, Bound);
+		if (DynamicRenderState)
+		{
+			States.Apply(CommandBuffer, Item.Object->State);
+		}
+		DrawWithPushConstants(CommandBuffer, Item);
 	}
 }
 
+void vlkn::ShaderSystem::RenderIndirect(FrameInfo& frameInfo)
+{
+	IndirectFrame& Frame = IndirectFrames[frameInfo.FrameIndex];
+	FallbackItems.clear();
+
+	EnsureIndirectCapacity(Frame, static_cast<uint32_t>(DrawItems.size()));
+
+	auto* Commands = static_cast<VkDrawIndexedIndirectCommand*>(Frame.Commands->GetMappedMemory());
+	auto* Objects = static_cast<IndirectObjectData*>(Frame.Objects->GetMappedMemory());
+
+	uint32_t DrawCount = 0;
+	for (const auto& Item : DrawItems)
+	{
+		const auto& Geometry = Item.Object->Model->GetGeometry();
+		if (Geometry.IndexCount == 0)
+		{
+			// Indexed indirect commands can't express non-indexed geometry.
+			FallbackItems.push_back(&Item);
+			continue;
+		}
+
+		Commands[DrawCount].indexCount = Geometry.IndexCount;
+		Commands[DrawCount].instanceCount = 1;
+		Commands[DrawCount].firstIndex = Geometry.FirstIndex;
+		Commands[DrawCount].vertexOffset = Geometry.VertexOffset;
+		Commands[DrawCount].firstInstance = DrawCount;
+
+		Objects[DrawCount].ModelMatrix = Item.ModelMatrix;
+		Objects[DrawCount].NormalMatrix = Item.NormalMatrix;
+		DrawCount++;
+	}
+
+	Frame.Commands->Flush();
+	Frame.Objects->Flush();
+
+	// Transient set from the frame's descriptor allocator, so a regrown object buffer needs no rewrite.
+	VkDescriptorSet ObjectSet;
+	auto BufferInfo = Frame.Objects->DescriptorInfo();
+	if (!VulkanDescriptorWriter(*ObjectSetLayout, frameInfo.FrameDescriptors).WriteBuffer(0, &BufferInfo).Build(ObjectSet))
+	{
+		throw std::runtime_error("Failed to Allocate Indirect Object Descriptor Set");
+	}
+
+	// A single multi-draw can't switch pipelines, so the indirect path draws everything with the default variant.
+	IndirectPipeline->bind(frameInfo.CommandBuffer);
+	// Likewise with the default render state.
+	StateRecorder.Reset();
+	if (DynamicRenderState)
+	{
+		StateRecorder.Apply(frameInfo.CommandBuffer, RenderState{});
+	}
+
+	std::array<VkDescriptorSet, 2> Sets{ frameInfo.GlobalDescriptorSet, ObjectSet };
+	vkCmdBindDescriptorSets(
+		frameInfo.CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, IndirectPipelineLayout,
+		0, static_cast<uint32_t>(Sets.size()), Sets.data(), 1, &frameInfo.GlobalUboOffset);
+
+	frameInfo.Geometry.Bind(frameInfo.CommandBuffer);
+
+	const uint32_t Stride = sizeof(VkDrawIndexedIndirectCommand);
+	const bool MultiDraw = Device.enabledFeatures().multiDrawIndirect;
+	const uint32_t MaxDraws = Device.properties.limits.maxDrawIndirectCount;
+	if (DrawCount > 0 && CmdDrawIndexedIndirectCount != nullptr)
+	{
+		auto* Counts = static_cast<uint32_t*>(Frame.DrawCount->GetMappedMemory());
+		uint32_t Chunk = 0;
+		for (uint32_t First = 0; First < DrawCount; First += MaxDraws, Chunk++)
+		{
+			Counts[Chunk] = std::min(MaxDraws, DrawCount - First);
+			CmdDrawIndexedIndirectCount(frameInfo.CommandBuffer, Frame.Commands->GetBuffer(), static_cast<VkDeviceSize>(First) * Stride,
+				Frame.DrawCount->GetBuffer(), static_cast<VkDeviceSize>(Chunk) * sizeof(uint32_t), Counts[Chunk], Stride);
+		}
+		Frame.DrawCount->Flush();
+	}
+	else if (DrawCount > 0 && MultiDraw)
+	{
+		for (uint32_t First = 0; First < DrawCount; First += MaxDraws)
+		{
+			vkCmdDrawIndexedIndirect(frameInfo.CommandBuffer, Frame.Commands->GetBuffer(),
+				static_cast<VkDeviceSize>(First) * Stride, std::min(MaxDraws, DrawCount - First), Stride);
+		}
+	}
+	else
+	{
+		for (uint32_t i = 0; i < DrawCount; i++)
+		{
+			vkCmdDrawIndexedIndirect(frameInfo.CommandBuffer, Frame.Commands->GetBuffer(),
+				static_cast<VkDeviceSize>(i) * Stride, 1, Stride);
+		}
+	}
+
+	if (!FallbackItems.empty())
+	{
+		Pipeline* Bound = nullptr;
+		BindGlobalSet(frameInfo, frameInfo.CommandBuffer, PipelineLayout);
+		for (const auto* Item : FallbackItems)
+		{
+			BindPipeline(*Item->DirectVariant, frameInfo.CommandBuffer, Bound);
+			if (DynamicRenderState)
+			{
+				StateRecorder.Apply(frameInfo.CommandBuffer, Item->Object->State);
+			}
+			DrawWithPushConstants(frameInfo.CommandBuffer, *Item);
+		}
+	}
+}
+
+void vlkn::ShaderSystem::RenderInstanced(FrameInfo& frameInfo)
+{
+	GroupLookup.clear();
+	Groups.clear();
+	GroupedItems.clear();
+
+	for (const auto& Item : DrawItems)
+	{
+		// Without dynamic render state every group draws with the pipeline's baked state anyway.
+		InstanceGroupKey Key{ Item.Object->Model.get(), DynamicRenderState ? Item.Object->State : RenderState{} };
+		auto Inserted = GroupLookup.emplace(Key, static_cast<uint32_t>(Groups.size()));
+		if (Inserted.second)
+		{
+			Groups.push_back({ Key.GroupModel, Key.State, 0, 0 });
+		}
+		uint32_t GroupIndex = Inserted.first->second;
+		Groups[GroupIndex].InstanceCount++;
+		GroupedItems.emplace_back(GroupIndex, &Item);
+	}
+
+	// Lay the groups out back to back; InstanceCount is rebuilt as the write cursor below.
+	uint32_t InstanceTotal = 0;
+	for (auto& Group : Groups)
+	{
+		Group.FirstInstance = InstanceTotal;
+		InstanceTotal += Group.InstanceCount;
+		Group.InstanceCount = 0;
+	}
+
+	EnsureInstanceCapacity(frameInfo.FrameIndex, InstanceTotal);
+	auto& InstanceBuffer = InstanceBuffers[frameInfo.FrameIndex];
+	auto* Instances = static_cast<InstanceData*>(InstanceBuffer->GetMappedMemory());
+
+	for (auto& Entry : GroupedItems)
+	{
+		auto& Group = Groups[Entry.first];
+		auto& Instance = Instances[Group.FirstInstance + Group.InstanceCount++];
+		Instance.ModelMatrix = Entry.second->ModelMatrix;
+		Instance.NormalMatrix = Entry.second->NormalMatrix;
+	}
+	InstanceBuffer->Flush();
+
+	Pipeline* Bound = nullptr;
+	StateRecorder.Reset();
+	BindGlobalSet(frameInfo, frameInfo.CommandBuffer, PipelineLayout);
+
+	frameInfo.Geometry.Bind(frameInfo.CommandBuffer);
+	VkBuffer Buffers[] = { InstanceBuffer->GetBuffer() };
+	VkDeviceSize Offsets[] = { 0 };
+	vkCmdBindVertexBuffers(frameInfo.CommandBuffer, 1, 1, Buffers, Offsets);
+
+	for (auto& Group : Groups)
+	{
+		BindVariant(*InstancedVariants, *Group.GroupModel, frameInfo.CommandBuffer, Bound);
+		if (DynamicRenderState)
+		{
+			StateRecorder.Apply(frameInfo.CommandBuffer, Group.State);
+		}
+		Group.GroupModel->Draw(frameInfo.CommandBuffer, Group.InstanceCount, Group.FirstInstance);
+	}
+}
+
+size_t vlkn::ShaderSystem::InstanceGroupKeyHash::operator()(const InstanceGroupKey& key) const
+{
+	size_t Seed = RenderState::Hash{}(key.State);
+	hashCombine(Seed, key.GroupModel);
+	return Seed;
+}
+
+// The global set is a dynamic uniform buffer; the frame's slice is selected by its dynamic offset.
+void vlkn::ShaderSystem::BindGlobalSet(FrameInfo& frameInfo, VkCommandBuffer CommandBuffer, VkPipelineLayout Layout)
+{
+	vkCmdBindDescriptorSets(
+		CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Layout,
+		0, 1, &frameInfo.GlobalDescriptorSet, 1, &frameInfo.GlobalUboOffset);
+}
+
+void vlkn::ShaderSystem::DrawWithPushConstants(VkCommandBuffer CommandBuffer, const DrawItem& Item)
+{
+	SimplePushConstantData Push{};
+
+	Push.ModelMatrix = Item.ModelMatrix;
+	Push.NormalMatrix = Item.NormalMatrix;
+
+	vkCmdPushConstants(CommandBuffer, PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &Push);
+	Item.Object->Model->Draw(CommandBuffer);
+}
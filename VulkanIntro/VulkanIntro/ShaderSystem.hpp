@@ -1,31 +1,206 @@
 #pragma once
 
+#include "JobSystem.hpp"
+#include "ParallelCommandRecorder.hpp"
 #include "Pipeline.hpp"
+#include "PipelineCompiler.hpp"
+#include "ShaderVariantRegistry.hpp"
 #include "VulkanDevice.hpp"
+#include "RenderState.hpp"
 #include "GameObject.hpp"
 #include "Camera.hpp"
 #include "FrameInfo.hpp"
+#include "FrameResources.hpp"
+#include "VulkanBufferObjects.hpp"
+#include "VulkanDescriptors.hpp"
 
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace vlkn {
 	class ShaderSystem{
 	public:
 
-		ShaderSystem(VulkanDevice& Device, VkRenderPass RenderPass, VkDescriptorSetLayout globalSetLayout);
+		// With useDynamicRenderState, and a Vulkan 1.3 device, each object's RenderState is set per draw instead
+		// of being baked into its pipeline. Per-frame buffers follow Frames' resizes.
+		ShaderSystem(VulkanDevice& Device, const RenderTargetInfo& Target, VkDescriptorSetLayout globalSetLayout, PipelineRegistry& Registry,
+			JobSystem& Jobs, FrameResources& Frames, bool useDynamicRenderState = false);
 		~ShaderSystem();
 
 		ShaderSystem(const ShaderSystem&) = delete;
 		ShaderSystem& operator=(const ShaderSystem&) = delete;
 
+		// Direct records a push constant and draw per object. Indirect writes every draw into a per-frame
+		// command buffer and submits the scene with one vkCmdDrawIndexedIndirect(Count). Instanced groups
+		// objects by Model and issues one instanced draw per group from a per-frame instance buffer.
+		enum class DrawPath { Direct, Indirect, Instanced };
+
+		struct RecordingBenchmarkResult {
+			size_t ObjectCount = 0;
+			uint32_t ThreadCount = 0;
+			double SingleThreadMs = 0.0;
+			double ParallelMs = 0.0;
+		};
+
+		void SetDrawPath(DrawPath path);
+		DrawPath GetDrawPath() const { return Path; }
+		bool SupportsIndirect() const { return IndirectPipeline != nullptr; }
+		bool UsesDynamicRenderState() const { return DynamicRenderState; }
+		uint64_t GetRenderStateCommandCount() const;
+
+		// Records the direct path into secondary command buffers on up to this many job system threads; 1 records
+		// inline into the frame's command buffer and 0 uses every thread. Call while no frame is in flight.
+		void SetRecordingThreads(uint32_t threadCount);
+		uint32_t GetRecordingThreads() const { return Recorder != nullptr ? Recorder->GetMaxRanges() : 1; }
+		// Whether the render pass of this frame must be begun with secondary command buffer contents.
+		bool RecordsInSecondaries() const { return Recorder != nullptr && Path == DrawPath::Direct; }
+		// Times recording frameInfo's objects on the direct path into secondaries, on one thread and on every
+		// recording thread, best of a few runs. Nothing is submitted; frameInfo.FrameIndex must not be in flight.
+		RecordingBenchmarkResult BenchmarkRecording(FrameInfo& frameInfo);
+
+		// One request per draw path the device supports, in the order Direct, Instanced, Indirect.
+		std::vector<PipelineCompiler::Request> GetPipelineRequests(const RenderTargetInfo& Target) const;
+
+		// Builds the shader variants the given objects need up front instead of on first draw.
+		void PrewarmVariants(const GameObject::Map& GameObjects);
+		size_t GetVariantCount() const { return DirectVariants->GetVariantCount() + InstancedVariants->GetVariantCount(); }
+
+		// Rebuilds every pipeline in use on the compiler's threads, after reading the shaders on the job system.
+		// recompiled lists the .spv files that changed; those are read from disk from now on, every other shader
+		// keeps its embedded SPIR-V. Rendering carries on with the old pipelines until the whole new set is ready.
+		void RequestReload(const std::vector<std::string>& recompiled);
+		// Call at the start of each frame, after its fence has been waited on. Swaps in a finished reload
+		// and releases retired pipelines once the frames that used them have completed.
+		void ApplyPendingReload();
+
+		// Gathers the objects to draw and computes their matrices on the job system. Has no GPU side effects,
+		// so it can run alongside other frame work; RenderGameObjects calls it if it wasn't called this frame.
+		void PrepareFrame(FrameInfo& frameInfo);
 		void RenderGameObjects(FrameInfo& frameInfo);
 	private:
-		void CreatePipelineLayout(VkDescriptorSetLayout globalSetLayout);
-		void CreatePipeline(VkRenderPass RenderPass);
+		struct IndirectFrame {
+			std::unique_ptr<VulkanBufferObjects> Commands;
+			std::unique_ptr<VulkanBufferObjects> Objects;
+			std::unique_ptr<VulkanBufferObjects> DrawCount;
+			uint32_t Capacity = 0;
+		};
+
+		struct PipelineSet {
+			std::unique_ptr<ShaderVariantRegistry> DirectVariants;
+			std::unique_ptr<ShaderVariantRegistry> InstancedVariants;
+			std::shared_future<std::shared_ptr<Pipeline>> IndirectBuild;
+			std::shared_ptr<Pipeline> IndirectPipeline;
+			// The last frame recorded with these pipelines.
+			uint64_t LastUsedFrame = 0;
+		};
+
+		// A reload's pipeline requests, made on the job system since they read the edited .spv files.
+		struct ReloadSetup {
+			JobCounter Done;
+			PipelineSet Set;
+		};
+
+		struct DrawItem {
+			GameObject* Object;
+			// Resolved while preparing, so recording never takes the variant registry's lock.
+			Pipeline* DirectVariant;
+			glm::mat4 ModelMatrix;
+			glm::mat4 NormalMatrix;
+		};
+
+		struct InstanceGroup {
+			Model* GroupModel;
+			RenderState State;
+			uint32_t FirstInstance;
+			uint32_t InstanceCount;
+		};
+
+		struct InstanceGroupKey {
+			Model* GroupModel;
+			RenderState State;
+
+			bool operator==(const InstanceGroupKey& other) const { return GroupModel == other.GroupModel && State == other.State; }
+		};
+
+		struct InstanceGroupKeyHash {
+			size_t operator()(const InstanceGroupKey& key) const;
+		};
+
+		void CreatePipelineLayouts(VkDescriptorSetLayout globalSetLayout);
+		void CreatePipelines();
+		void StartReload();
+		PipelineSet RequestPipelineSet(const std::vector<ShaderVariantKey>& DirectKeys, const std::vector<ShaderVariantKey>& InstancedKeys);
+		bool IsRecompiled(const std::string& FilePath) const;
+		PipelineCompiler::Request MakePipelineRequest(const RenderTargetInfo& Target, VkPipelineLayout Layout, const std::string& VertFilePath) const;
+		PipelineCompiler::Request MakeDirectRequest(const RenderTargetInfo& Target) const;
+		PipelineCompiler::Request MakeInstancedRequest(const RenderTargetInfo& Target) const;
+		static ShaderVariantKey VariantFor(const Model& model);
+		// Binds the model's variant unless it is already the bound pipeline.
+		void BindVariant(ShaderVariantRegistry& Variants, const Model& model, VkCommandBuffer CommandBuffer, Pipeline*& Bound);
+		static void BindPipeline(Pipeline& Variant, VkCommandBuffer CommandBuffer, Pipeline*& Bound);
+		void CreateIndirectResources();
+		void EnsureIndirectCapacity(IndirectFrame& frame, uint32_t drawCount);
+		void CreateInstanceResources();
+		void EnsureInstanceCapacity(int frameIndex, uint32_t instanceCount);
+		// Called with the device idle.
+		void ResizeFrames(uint32_t frameCount);
+		void ResizeIndirectFrames(uint32_t frameCount);
+		void ResizeInstanceBuffers(uint32_t frameCount);
+
+		void RenderDirect(FrameInfo& frameInfo);
+		// Skips objects whose model is still uploading unless includeUnready.
+		void PrepareDrawItems(FrameInfo& frameInfo, bool includeUnready);
+		void RecordDirectRange(FrameInfo& frameInfo, VkCommandBuffer CommandBuffer, RenderStateRecorder& States, size_t Begin, size_t End);
+		void RenderIndirect(FrameInfo& frameInfo);
+		void RenderInstanced(FrameInfo& frameInfo);
+		void DrawWithPushConstants(VkCommandBuffer CommandBuffer, const DrawItem& Item);
+		void BindGlobalSet(FrameInfo& frameInfo, VkCommandBuffer CommandBuffer, VkPipelineLayout Layout);
 		
 		VulkanDevice& Device;
-		std::unique_ptr<Pipeline> pipeline;
+		PipelineRegistry& Registry;
+		JobSystem& Jobs;
+		FrameResources& Frames;
+		// Must outlive every swapchain; see Renderer::GetSwapchainRenderTarget.
+		RenderTargetInfo RenderTarget;
+		bool DynamicRenderState;
+		RenderStateRecorder StateRecorder;
+		std::unique_ptr<ParallelCommandRecorder> Recorder;
+		// One per recording thread, as each secondary starts without any state set.
+		std::vector<RenderStateRecorder> ThreadStateRecorders;
+		// Every ready object of the frame, in GameObject::Map order.
+		std::vector<DrawItem> DrawItems;
+		bool FramePrepared = false;
+		std::unique_ptr<ShaderVariantRegistry> DirectVariants;
 		VkPipelineLayout PipelineLayout;
+
+		// Every device supports instancing; SetDrawPath picks another path.
+		DrawPath Path = DrawPath::Instanced;
+		std::shared_ptr<Pipeline> IndirectPipeline;
+		VkPipelineLayout IndirectPipelineLayout = VK_NULL_HANDLE;
+		std::shared_ptr<VulkanDescriptorSetLayout> ObjectSetLayout;
+		std::vector<IndirectFrame> IndirectFrames;
+		std::vector<const DrawItem*> FallbackItems;
+		PFN_vkCmdDrawIndexedIndirectCountKHR CmdDrawIndexedIndirectCount = nullptr;
+
+		std::unique_ptr<ShaderVariantRegistry> InstancedVariants;
+
+		std::unique_ptr<ReloadSetup> ReloadInSetup;
+		// Shaders changed since the last reload was started; a reload arriving during a setup waits here.
+		std::vector<std::string> QueuedShaders;
+		std::unique_ptr<PipelineSet> PendingReload;
+		std::vector<PipelineSet> RetiredSets;
+		// Shaders hot reload has recompiled, which are read from disk from then on; every other shader comes
+		// from the SPIR-V embedded at build time. Only changed while no reload is being set up, as the setup
+		// reads it.
+		std::vector<std::string> RecompiledShaders;
+		std::vector<std::unique_ptr<VulkanBufferObjects>> InstanceBuffers;
+		// Scratch storage reused every frame so grouping does not allocate once warmed up.
+		std::unordered_map<InstanceGroupKey, uint32_t, InstanceGroupKeyHash> GroupLookup;
+		std::vector<InstanceGroup> Groups;
+		std::vector<std::pair<uint32_t, const DrawItem*>> GroupedItems;
+		FrameResources::Registration FramesRegistration;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "ShaderVariantRegistry.hpp"
+#include "Utils.hpp"
+
+#include <chrono>
+#include <future>
+#include <utility>
+
+namespace vlkn {
+
+	void ShaderVariantKey::Apply(SpecializationConstants& Constants) const
+	{
+		Constants.Set(LIGHT_COUNT_ID, LightCount);
+		Constants.Set(HAS_VERTEX_COLOR_ID, HasVertexColor);
+		Constants.Set(HAS_NORMALS_ID, HasNormals);
+	}
+
+	size_t ShaderVariantKey::Hash::operator()(const ShaderVariantKey& key) const
+	{
+		size_t Seed = 0;
+		hashCombine(Seed, key.LightCount, key.HasVertexColor, key.HasNormals);
+		return Seed;
+	}
+
+	ShaderVariantRegistry::ShaderVariantRegistry(PipelineRegistry& registry, RequestFactory makeRequest)
+		: Registry{ registry }, MakeRequest{ std::move(makeRequest) }
+	{
+	}
+
+	Pipeline& ShaderVariantRegistry::Get(const ShaderVariantKey& key)
+	{
+		std::shared_future<std::shared_ptr<Pipeline>> Build;
+		{
+			std::lock_guard<std::mutex> Lock{ Mutex };
+			Variant& Entry = FindOrRequest(key);
+			if (Entry.Resolved)
+			{
+				return *Entry.Resolved;
+			}
+			Build = Entry.Build;
+		}
+
+		std::shared_ptr<Pipeline> Built = Build.get();
+
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		Variants.at(key).Resolved = Built;
+		return *Built;
+	}
+
+	void ShaderVariantRegistry::Request(const std::vector<ShaderVariantKey>& keys)
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		for (const auto& Key : keys)
+		{
+			FindOrRequest(Key);
+		}
+	}
+
+	void ShaderVariantRegistry::Prewarm(const std::vector<ShaderVariantKey>& keys)
+	{
+		Request(keys);
+		for (const auto& Key : keys)
+		{
+			Get(Key);
+		}
+	}
+
+	bool ShaderVariantRegistry::IsReady() const
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		for (const auto& [Key, Entry] : Variants)
+		{
+			if (!Entry.Resolved && Entry.Build.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::vector<ShaderVariantKey> ShaderVariantRegistry::GetKeys() const
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		std::vector<ShaderVariantKey> Keys;
+		for (const auto& [Key, Entry] : Variants)
+		{
+			Keys.push_back(Key);
+		}
+		return Keys;
+	}
+
+	size_t ShaderVariantRegistry::GetVariantCount() const
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		return Variants.size();
+	}
+
+	// Expects Mutex to be held.
+	ShaderVariantRegistry::Variant& ShaderVariantRegistry::FindOrRequest(const ShaderVariantKey& key)
+	{
+		auto It = Variants.find(key);
+		if (It == Variants.end())
+		{
+			It = Variants.emplace(key, Variant{ Registry.Request(MakeVariantRequest(key)), nullptr }).first;
+		}
+		return It->second;
+	}
+
+	PipelineCompiler::Request ShaderVariantRegistry::MakeVariantRequest(const ShaderVariantKey& key) const
+	{
+		auto Request = MakeRequest();
+		key.Apply(Request.Config->specialization);
+		return Request;
+	}
+}
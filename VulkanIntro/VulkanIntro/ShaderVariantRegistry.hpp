@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Pipeline.hpp"
+#include "PipelineCompiler.hpp"
+#include "PipelineRegistry.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vlkn {
+
+	// Feature toggles baked into the shaders as specialization constants. The ids match the
+	// constant_id declarations in shader.vert, shader_instanced.vert and shader.frag.
+	struct ShaderVariantKey {
+		enum ConstantId : uint32_t { LIGHT_COUNT_ID = 0, HAS_VERTEX_COLOR_ID = 1, HAS_NORMALS_ID = 2 };
+
+		// GlobalUBO carries a single point light, so this is 0 (ambient only) or 1.
+		uint32_t LightCount = 1;
+		bool HasVertexColor = true;
+		bool HasNormals = true;
+
+		void Apply(SpecializationConstants& Constants) const;
+
+		bool operator==(const ShaderVariantKey& other) const
+		{
+			return LightCount == other.LightCount && HasVertexColor == other.HasVertexColor && HasNormals == other.HasNormals;
+		}
+		bool operator!=(const ShaderVariantKey& other) const { return !(*this == other); }
+
+		struct Hash {
+			size_t operator()(const ShaderVariantKey& key) const;
+		};
+	};
+
+	// Builds one pipeline per variant key on first use. Every variant starts from the same base request,
+	// so only the specialization constants differ between them. Pipelines come from the PipelineRegistry,
+	// so variants that end up with identical state share a pipeline.
+	class ShaderVariantRegistry {
+	public:
+		using RequestFactory = std::function<PipelineCompiler::Request()>;
+
+		ShaderVariantRegistry(PipelineRegistry& registry, RequestFactory makeRequest);
+
+		ShaderVariantRegistry(const ShaderVariantRegistry&) = delete;
+		ShaderVariantRegistry& operator=(const ShaderVariantRegistry&) = delete;
+
+		// Blocks while a missing variant is compiled; rethrows if its build failed.
+		Pipeline& Get(const ShaderVariantKey& key);
+
+		// Starts building the keys that are not requested yet without waiting for them.
+		void Request(const std::vector<ShaderVariantKey>& keys);
+		// Compiles all of the keys that are not built yet concurrently and waits for them.
+		void Prewarm(const std::vector<ShaderVariantKey>& keys);
+
+		// True once every requested variant has finished building, successfully or not.
+		bool IsReady() const;
+		std::vector<ShaderVariantKey> GetKeys() const;
+		size_t GetVariantCount() const;
+
+	private:
+		struct Variant {
+			std::shared_future<std::shared_ptr<Pipeline>> Build;
+			// Set on first use so the hot path does not go through the future.
+			std::shared_ptr<Pipeline> Resolved;
+		};
+
+		Variant& FindOrRequest(const ShaderVariantKey& key);
+		PipelineCompiler::Request MakeVariantRequest(const ShaderVariantKey& key) const;
+
+		PipelineRegistry& Registry;
+		RequestFactory MakeRequest;
+		std::unordered_map<ShaderVariantKey, Variant, ShaderVariantKey::Hash> Variants;
+		mutable std::mutex Mutex;
+	};
+}
@@ -0,0 +1,212 @@
+#include "ShaderWatcher.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace vlkn {
+
+	namespace {
+		// Editors often save in several writes; changes are collected until the directory has been quiet this long.
+		constexpr auto SETTLE_TIME = std::chrono::milliseconds(100);
+		constexpr auto POLL_INTERVAL = std::chrono::milliseconds(250);
+	}
+
+	ShaderWatcher::ShaderWatcher(const std::string& directory) : Directory{ directory }, CompilerPath{ GetCompilerPath() }
+	{
+#ifdef __linux__
+		NotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (NotifyFd < 0 || inotify_add_watch(NotifyFd, Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		{
+			std::cout << "Shader hot reload disabled, cannot watch " << Directory.string() << "\n";
+			return;
+		}
+#else
+		std::error_code Error;
+		for (const auto& Entry : std::filesystem::directory_iterator(Directory, Error))
+		{
+			if (IsShaderSource(Entry.path()))
+			{
+				WriteTimes[Entry.path().string()] = Entry.last_write_time(Error);
+			}
+		}
+#endif
+		Worker = std::thread(&ShaderWatcher::WatchLoop, this);
+	}
+
+	ShaderWatcher::~ShaderWatcher()
+	{
+		Stopping = true;
+		if (Worker.joinable())
+		{
+			Worker.join();
+		}
+#ifdef __linux__
+		if (NotifyFd >= 0)
+		{
+			close(NotifyFd);
+		}
+#endif
+	}
+
+	std::vector<std::string> ShaderWatcher::TakeRecompiled()
+	{
+		std::vector<std::string> Taken;
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		Taken.swap(Recompiled);
+		return Taken;
+	}
+
+	bool ShaderWatcher::IsShaderSource(const std::filesystem::path& path)
+	{
+		auto Extension = path.extension();
+		return Extension == ".vert" || Extension == ".frag";
+	}
+
+	std::string ShaderWatcher::GetCompilerPath()
+	{
+		// Same compiler compile.bat uses, falling back to whatever glslc is on the PATH.
+		if (const char* Sdk = std::getenv("VULKAN_SDK"))
+		{
+#ifdef _WIN32
+			return (std::filesystem::path(Sdk) / "Bin" / "glslc.exe").string();
+#else
+			return (std::filesystem::path(Sdk) / "bin" / "glslc").string();
+#endif
+		}
+		return "glslc";
+	}
+
+	void ShaderWatcher::WatchLoop()
+	{
+		std::vector<std::filesystem::path> Changed;
+		while (!Stopping)
+		{
+			Changed.clear();
+			WaitForChanges(Changed);
+
+			for (const auto& Source : Changed)
+			{
+				if (Compile(Source))
+				{
+					std::lock_guard<std::mutex> Lock{ Mutex };
+					Recompiled.push_back(Source.string() + ".spv");
+				}
+			}
+		}
+	}
+
+	// Returns once at least one source changed and things have settled, or when stopping.
+	void ShaderWatcher::WaitForChanges(std::vector<std::filesystem::path>& changed)
+	{
+		auto AddChange = [&](const std::filesystem::path& path) {
+			if (IsShaderSource(path) && std::find(changed.begin(), changed.end(), path) == changed.end())
+			{
+				changed.push_back(path);
+			}
+		};
+
+#ifdef __linux__
+		alignas(inotify_event) char Buffer[4096];
+		while (!Stopping)
+		{
+			pollfd Poll{ NotifyFd, POLLIN, 0 };
+			int Timeout = static_cast<int>((changed.empty() ? POLL_INTERVAL : SETTLE_TIME).count());
+			if (poll(&Poll, 1, Timeout) <= 0)
+			{
+				if (!changed.empty())
+				{
+					return;
+				}
+				continue;
+			}
+
+			ssize_t Length;
+			while ((Length = read(NotifyFd, Buffer, sizeof(Buffer))) > 0)
+			{
+				for (char* Ptr = Buffer; Ptr < Buffer + Length;)
+				{
+					auto* Event = reinterpret_cast<inotify_event*>(Ptr);
+					if (Event->len > 0)
+					{
+						AddChange(Directory / Event->name);
+					}
+					Ptr += sizeof(inotify_event) + Event->len;
+				}
+			}
+		}
+#else
+		while (!Stopping)
+		{
+			std::this_thread::sleep_for(changed.empty() ? POLL_INTERVAL : SETTLE_TIME);
+
+			bool Modified = false;
+			std::error_code Error;
+			for (const auto& Entry : std::filesystem::directory_iterator(Directory, Error))
+			{
+				if (!IsShaderSource(Entry.path()))
+				{
+					continue;
+				}
+
+				auto WriteTime = Entry.last_write_time(Error);
+				auto& Known = WriteTimes[Entry.path().string()];
+				if (Known != WriteTime)
+				{
+					Known = WriteTime;
+					AddChange(Entry.path());
+					Modified = true;
+				}
+			}
+
+			if (!Modified && !changed.empty())
+			{
+				return;
+			}
+		}
+#endif
+	}
+
+	bool ShaderWatcher::Compile(const std::filesystem::path& source)
+	{
+		std::string Output = source.string() + ".spv";
+		std::string Temporary = Output + ".tmp";
+
+		std::ostringstream Command;
+		Command << "\"" << CompilerPath << "\" \"" << source.string() << "\" -o \"" << Temporary << "\"";
+#ifdef _WIN32
+		// cmd strips the outer pair of quotes, so wrap the whole line.
+		std::string CommandLine = "\"" + Command.str() + "\"";
+#else
+		std::string CommandLine = Command.str();
+#endif
+
+		auto Start = std::chrono::high_resolution_clock::now();
+		if (std::system(CommandLine.c_str()) != 0)
+		{
+			std::cout << "Shader hot reload: failed to compile " << source.string() << ", keeping the previous version\n";
+			std::error_code Error;
+			std::filesystem::remove(Temporary, Error);
+			return false;
+		}
+
+		std::error_code Error;
+		std::filesystem::rename(Temporary, Output, Error);
+		if (Error)
+		{
+			std::cout << "Shader hot reload: failed to replace " << Output << ": " << Error.message() << "\n";
+			return false;
+		}
+
+		float Ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - Start).count();
+		std::cout << "Shader hot reload: compiled " << source.string() << " in " << Ms << " ms\n";
+		return true;
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace vlkn {
+
+	// Watches a directory of GLSL sources and recompiles any that change to <source>.spv on a background
+	// thread. Uses inotify on Linux and polls modification times elsewhere. Output is written to a
+	// temporary file and renamed into place, so readers never see a partially written .spv.
+	class ShaderWatcher {
+	public:
+		ShaderWatcher(const std::string& directory);
+		~ShaderWatcher();
+
+		ShaderWatcher(const ShaderWatcher&) = delete;
+		ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+		// The .spv files recompiled successfully since the last call.
+		std::vector<std::string> TakeRecompiled();
+
+	private:
+		static bool IsShaderSource(const std::filesystem::path& path);
+		static std::string GetCompilerPath();
+
+		void WatchLoop();
+		void WaitForChanges(std::vector<std::filesystem::path>& changed);
+		bool Compile(const std::filesystem::path& source);
+
+		std::filesystem::path Directory;
+		std::string CompilerPath;
+		std::atomic<bool> Stopping{ false };
+		std::thread Worker;
+
+		std::mutex Mutex;
+		std::vector<std::string> Recompiled;
+
+#ifdef __linux__
+		int NotifyFd = -1;
+#else
+		std::unordered_map<std::string, std::filesystem::file_time_type> WriteTimes;
+#endif
+	};
+}
@@ -0,0 +1,147 @@
+#include "StagingRing.hpp"
+
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace vlkn {
+
+	StagingRing::StagingRing(VulkanDevice& device, VkDeviceSize size) : Device{device}, Capacity{size}
+	{
+		Device.createBuffer(Capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, Buffer, Allocation);
+		Mapped = static_cast<char*>(Allocation.Mapped);
+		assert(Mapped != nullptr && "Staging ring memory must be host visible.");
+	}
+
+	StagingRing::~StagingRing()
+	{
+		while (!InFlight.empty())
+		{
+			RetireOldest();
+		}
+		for (auto Fence : FreeFences)
+		{
+			vkDestroyFence(Device.device(), Fence, nullptr);
+		}
+		Device.destroyBuffer(Buffer, Allocation);
+	}
+
+	/**
+ * Reserves a region of the ring for the currently open batch, waiting for older batches to retire if
+ * the ring is full.
+ *
+ * @param size Size of the region in bytes. Must not exceed the ring capacity.
+ * @param alignment Required alignment of the region offset
+ * @param region Receives the reserved region
+ *
+ * @return false if the space is held by the open batch itself, in which case the caller must close and
+ * submit the batch before retrying.
+ */
+	bool StagingRing::TryReserve(VkDeviceSize size, VkDeviceSize alignment, Region& region)
+	{
+		assert(size <= Capacity && "Staging reservation larger than the ring. Split the transfer.");
+
+		for (;;)
+		{
+			if (UsedBytes == 0)
+			{
+				Head = 0;
+			}
+
+			VkDeviceSize Start = alignment > 1 ? (Head + alignment - 1) / alignment * alignment : Head;
+			VkDeviceSize Consumed;
+			if (Start + size > Capacity)
+			{
+				// Skip the tail of the ring and wrap around to the beginning.
+				Start = 0;
+				Consumed = (Capacity - Head) + size;
+			}
+			else
+			{
+				Consumed = (Start - Head) + size;
+			}
+
+			if (UsedBytes + Consumed <= Capacity)
+			{
+				Head = Start + size;
+				UsedBytes += Consumed;
+				OpenBytes += Consumed;
+
+				region.Buffer = Buffer;
+				region.Offset = Start;
+				region.Size = size;
+				region.Mapped = Mapped + Start;
+				return true;
+			}
+
+			if (InFlight.empty())
+			{
+				return false;
+			}
+			RetireOldest();
+		}
+	}
+
+	/**
+ * Closes the open batch. The returned fence must be passed to the vkQueueSubmit that consumes every
+ * region reserved since the previous call; the regions are reused once it signals.
+ */
+	StagingRing::Batch StagingRing::CloseBatch()
+	{
+		Batch NewBatch{ AcquireFence(), NextSerial++ };
+		InFlight.push_back({ NewBatch.Fence, NewBatch.Serial, OpenBytes });
+		OpenBytes = 0;
+		return NewBatch;
+	}
+
+	bool StagingRing::IsComplete(uint64_t serial)
+	{
+		while (!InFlight.empty() && vkGetFenceStatus(Device.device(), InFlight.front().Fence) == VK_SUCCESS)
+		{
+			RetireOldest();
+		}
+		return serial <= CompletedSerial;
+	}
+
+	void StagingRing::WaitFor(uint64_t serial)
+	{
+		assert(serial < NextSerial && "Waiting for a batch that was never closed.");
+		while (CompletedSerial < serial)
+		{
+			RetireOldest();
+		}
+	}
+
+	void StagingRing::RetireOldest()
+	{
+		auto& Oldest = InFlight.front();
+		vkWaitForFences(Device.device(), 1, &Oldest.Fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		vkResetFences(Device.device(), 1, &Oldest.Fence);
+
+		FreeFences.push_back(Oldest.Fence);
+		UsedBytes -= Oldest.Bytes;
+		CompletedSerial = Oldest.Serial;
+		InFlight.pop_front();
+	}
+
+	VkFence StagingRing::AcquireFence()
+	{
+		if (!FreeFences.empty())
+		{
+			VkFence Fence = FreeFences.back();
+			FreeFences.pop_back();
+			return Fence;
+		}
+
+		VkFenceCreateInfo FenceInfo{};
+		FenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		VkFence Fence;
+		if (vkCreateFence(Device.device(), &FenceInfo, nullptr, &Fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Staging Fence");
+		}
+		return Fence;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace vlkn {
+
+	// A persistently mapped, host-visible ring buffer that CPU data is written into before being copied
+	// to device-local memory. Regions are handed out in batches; each batch is closed with a fence that
+	// the caller submits with, and the space is reclaimed once that fence signals.
+	class StagingRing {
+	public:
+		static constexpr VkDeviceSize DEFAULT_SIZE = 16ull * 1024 * 1024;
+
+		struct Region {
+			VkBuffer Buffer = VK_NULL_HANDLE;
+			VkDeviceSize Offset = 0;
+			VkDeviceSize Size = 0;
+			void* Mapped = nullptr;
+		};
+
+		struct Batch {
+			VkFence Fence = VK_NULL_HANDLE;
+			uint64_t Serial = 0;
+		};
+
+		StagingRing(VulkanDevice& device, VkDeviceSize size = DEFAULT_SIZE);
+		~StagingRing();
+
+		StagingRing(const StagingRing&) = delete;
+		StagingRing& operator=(const StagingRing&) = delete;
+
+		bool TryReserve(VkDeviceSize size, VkDeviceSize alignment, Region& region);
+		Batch CloseBatch();
+		bool HasOpenBatch() const { return OpenBytes > 0; }
+
+		bool IsComplete(uint64_t serial);
+		void WaitFor(uint64_t serial);
+		uint64_t GetLastSubmittedSerial() const { return NextSerial - 1; }
+
+		VkDeviceSize GetCapacity() const { return Capacity; }
+
+	private:
+		struct InFlightBatch {
+			VkFence Fence;
+			uint64_t Serial;
+			VkDeviceSize Bytes;
+		};
+
+		void RetireOldest();
+		VkFence AcquireFence();
+
+		VulkanDevice& Device;
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VulkanAllocation Allocation{};
+		char* Mapped = nullptr;
+		VkDeviceSize Capacity;
+
+		VkDeviceSize Head = 0;
+		VkDeviceSize UsedBytes = 0;
+		VkDeviceSize OpenBytes = 0;
+
+		uint64_t NextSerial = 1;
+		uint64_t CompletedSerial = 0;
+		std::deque<InFlightBatch> InFlight;
+		std::vector<VkFence> FreeFences;
+	};
+}
@@ -1,6 +1,7 @@
 #include "Swapchain.hpp"
 
 // std
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <cstring>
@@ -11,14 +12,34 @@
 
 namespace vlkn {
 
-    Swapchain::Swapchain(VulkanDevice &deviceRef, VkExtent2D extent)
-    : device{deviceRef}, windowExtent{extent} {
-        init();
+const char *presentPolicyName(PresentPolicy policy) {
+  switch (policy) {
+    case PresentPolicy::VSync:
+      return "vsync";
+    case PresentPolicy::Mailbox:
+      return "mailbox";
+    case PresentPolicy::Immediate:
+      return "immediate";
+    case PresentPolicy::FifoRelaxed:
+      return "fifo relaxed";
+    case PresentPolicy::LowLatency:
+      return "low latency";
+  }
+  return "unknown";
+}
+
+    Swapchain::Swapchain(VulkanDevice &deviceRef, VkExtent2D extent, FrameResources &frames, const PresentSettings &present,
+        bool useDynamicRendering)
+    : device{deviceRef}, frames{frames}, windowExtent{extent}, dynamicRendering{useDynamicRendering},
+      presentSettings{present} {
+        init(frames.GetFramesInFlight());
     }
 
-    Swapchain::Swapchain(VulkanDevice& deviceRef, VkExtent2D extent, std::shared_ptr<Swapchain>Previous)
-        : device{ deviceRef }, windowExtent{ extent }, oldSwapchain{ Previous } {
-        init();
+    Swapchain::Swapchain(VulkanDevice& deviceRef, VkExtent2D extent, std::shared_ptr<Swapchain>Previous,
+        const PresentSettings &present)
+        : device{ deviceRef }, frames{ Previous->frames }, windowExtent{ extent }, oldSwapchain{ Previous },
+          dynamicRendering{ Previous->dynamicRendering }, presentSettings{ present } {
+        init(Previous->getFramesInFlight());
         oldSwapchain = nullptr;
     }
 
@@ -36,8 +57,7 @@ namespace vlkn {
 
   for (int i = 0; i < depthImages.size(); i++) {
     vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
-    vkDestroyImage(device.device(), depthImages[i], nullptr);
-    vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+    device.destroyImage(depthImages[i], depthImageAllocations[i]);
   }
 
   for (auto framebuffer : swapChainFramebuffers) {
@@ -46,21 +66,25 @@ namespace vlkn {
 
   vkDestroyRenderPass(device.device(), renderPass, nullptr);
 
-  // cleanup synchronization objects
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    vkDestroySemaphore(device.device(), renderFinishedSemaphores[i], nullptr);
-    vkDestroySemaphore(device.device(), imageAvailableSemaphores[i], nullptr);
-    vkDestroyFence(device.device(), inFlightFences[i], nullptr);
-  }
+  destroySyncObjects();
+}
+
+void Swapchain::setFramesInFlight(uint32_t framesInFlight) {
+  destroySyncObjects();
+  createSyncObjects(framesInFlight);
 }
 
 VkResult Swapchain::acquireNextImage(uint32_t *imageIndex) {
-  vkWaitForFences(
-      device.device(),
-      1,
-      &inFlightFences[currentFrame],
-      VK_TRUE,
-      std::numeric_limits<uint64_t>::max());
+  if (frames.UsesTimeline()) {
+    frames.WaitForFrame(frameTimelineValues[currentFrame]);
+  } else {
+    vkWaitForFences(
+        device.device(),
+        1,
+        &inFlightFences[currentFrame],
+        VK_TRUE,
+        std::numeric_limits<uint64_t>::max());
+  }
 
   VkResult result = vkAcquireNextImageKHR(
       device.device(),
@@ -75,10 +99,15 @@ VkResult Swapchain::acquireNextImage(uint32_t *imageIndex) {
 
 VkResult Swapchain::submitCommandBuffers(
     const VkCommandBuffer *buffers, uint32_t *imageIndex) {
-  if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
-    vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
+  // The acquire semaphore already orders rendering after the image's previous present; the wait on the
+  // image's last fence is only kept on the fence path.
+  const bool useTimeline = frames.UsesTimeline();
+  if (!useTimeline) {
+    if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
+      vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
+    }
+    imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
   }
-  imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -92,15 +121,33 @@ VkResult Swapchain::submitCommandBuffers(
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = buffers;
 
-  VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-  submitInfo.signalSemaphoreCount = 1;
+  // The timeline's value is ignored for the binary render finished semaphore.
+  const uint64_t frameNumber = frames.GetCurrentFrame();
+  VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[*imageIndex], frames.GetTimelineSemaphore()};
+  uint64_t signalValues[] = {0, frameNumber};
+  submitInfo.signalSemaphoreCount = useTimeline ? 2 : 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
-  if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
-      VK_SUCCESS) {
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  uint64_t waitValues[] = {0};
+  timelineInfo.waitSemaphoreValueCount = 1;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+  timelineInfo.signalSemaphoreValueCount = 2;
+  timelineInfo.pSignalSemaphoreValues = signalValues;
+
+  VkFence submitFence = VK_NULL_HANDLE;
+  if (useTimeline) {
+    submitInfo.pNext = &timelineInfo;
+    frameTimelineValues[currentFrame] = frameNumber;
+  } else {
+    submitFence = inFlightFences[currentFrame];
+    vkResetFences(device.device(), 1, &submitFence);
+  }
+  if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, submitFence) != VK_SUCCESS) {
     throw std::runtime_error("failed to submit draw command buffer!");
   }
+  frames.MarkFrameSubmitted();
 
   VkPresentInfoKHR presentInfo = {};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -116,33 +163,39 @@ VkResult Swapchain::submitCommandBuffers(
 
   auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
 
-  currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  currentFrame = (currentFrame + 1) % imageAvailableSemaphores.size();
 
   return result;
 }
 
-void Swapchain::init()
+void Swapchain::init(uint32_t framesInFlight)
 {
     createSwapChain();
     createImageViews();
-    createRenderPass();
+    if (!dynamicRendering) {
+      // Pipelines and recorded secondaries hold on to the render pass, so it is handed from swapchain to
+      // swapchain rather than recreated. The depth format only depends on the device.
+      if (oldSwapchain != nullptr && oldSwapchain->swapChainImageFormat == swapChainImageFormat) {
+        renderPass = oldSwapchain->renderPass;
+        oldSwapchain->renderPass = VK_NULL_HANDLE;
+      } else {
+        createRenderPass();
+      }
+    }
     createDepthResources();
-    createFramebuffers();
-    createSyncObjects();
+    if (!dynamicRendering) {
+      createFramebuffers();
+    }
+    createSyncObjects(framesInFlight);
 }
 
 void Swapchain::createSwapChain() {
   SwapChainSupportDetails swapChainSupport = device.getSwapChainSupport();
 
   VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-  VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+  presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
   VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
-
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-  if (swapChainSupport.capabilities.maxImageCount > 0 &&
-      imageCount > swapChainSupport.capabilities.maxImageCount) {
-    imageCount = swapChainSupport.capabilities.maxImageCount;
-  }
+  uint32_t imageCount = chooseImageCount(swapChainSupport.capabilities);
 
   VkSwapchainCreateInfoKHR createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -191,6 +244,11 @@ void Swapchain::createSwapChain() {
 
   swapChainImageFormat = surfaceFormat.format;
   swapChainExtent = extent;
+
+  const char *modeNames[] = {"immediate", "mailbox", "fifo", "fifo relaxed"};
+  std::cout << "Present: " << presentPolicyName(presentSettings.policy) << " policy, "
+            << (presentMode <= VK_PRESENT_MODE_FIFO_RELAXED_KHR ? modeNames[presentMode] : "other") << " mode, "
+            << imageCount << " images" << std::endl;
 }
 
 void Swapchain::createImageViews() {
@@ -306,7 +364,7 @@ void Swapchain::createDepthResources() {
   VkExtent2D swapChainExtent = getSwapChainExtent();
 
   depthImages.resize(imageCount());
-  depthImageMemorys.resize(imageCount());
+  depthImageAllocations.resize(imageCount());
   depthImageViews.resize(imageCount());
 
   for (int i = 0; i < depthImages.size(); i++) {
@@ -330,7 +388,7 @@ void Swapchain::createDepthResources() {
         imageInfo,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         depthImages[i],
-        depthImageMemorys[i]);
+        depthImageAllocations[i]);
 
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -349,11 +407,14 @@ void Swapchain::createDepthResources() {
   }
 }
 
-void Swapchain::createSyncObjects() {
-  imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-  imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+void Swapchain::createSyncObjects(uint32_t framesInFlight) {
+  const bool useTimeline = frames.UsesTimeline();
+  imageAvailableSemaphores.resize(framesInFlight);
+  renderFinishedSemaphores.resize(imageCount());
+  inFlightFences.resize(useTimeline ? 0 : framesInFlight);
+  imagesInFlight.assign(useTimeline ? 0 : imageCount(), VK_NULL_HANDLE);
+  frameTimelineValues.assign(useTimeline ? framesInFlight : 0, 0);
+  currentFrame = 0;
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -362,15 +423,36 @@ void Swapchain::createSyncObjects() {
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) !=
-            VK_SUCCESS ||
-        vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
-            VK_SUCCESS ||
-        vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+  for (auto &semaphore : imageAvailableSemaphores) {
+    if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
       throw std::runtime_error("failed to create synchronization objects for a frame!");
     }
   }
+  for (auto &semaphore : renderFinishedSemaphores) {
+    if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create synchronization objects for an image!");
+    }
+  }
+  for (auto &fence : inFlightFences) {
+    if (vkCreateFence(device.device(), &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create synchronization objects for a frame!");
+    }
+  }
+}
+
+void Swapchain::destroySyncObjects() {
+  for (auto semaphore : imageAvailableSemaphores) {
+    vkDestroySemaphore(device.device(), semaphore, nullptr);
+  }
+  for (auto semaphore : renderFinishedSemaphores) {
+    vkDestroySemaphore(device.device(), semaphore, nullptr);
+  }
+  for (auto fence : inFlightFences) {
+    vkDestroyFence(device.device(), fence, nullptr);
+  }
+  renderFinishedSemaphores.clear();
+  imageAvailableSemaphores.clear();
+  inFlightFences.clear();
 }
 
 VkSurfaceFormatKHR Swapchain::chooseSwapSurfaceFormat(
@@ -387,24 +469,49 @@ VkSurfaceFormatKHR Swapchain::chooseSwapSurfaceFormat(
 
 VkPresentModeKHR Swapchain::chooseSwapPresentMode(
     const std::vector<VkPresentModeKHR> &availablePresentModes) {
-  for (const auto &availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      std::cout << "Present mode: Mailbox" << std::endl;
-      return availablePresentMode;
-    }
+  std::vector<VkPresentModeKHR> preferred;
+  switch (presentSettings.policy) {
+    case PresentPolicy::Mailbox:
+    case PresentPolicy::LowLatency:
+      preferred = {VK_PRESENT_MODE_MAILBOX_KHR};
+      break;
+    case PresentPolicy::Immediate:
+      preferred = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+      break;
+    case PresentPolicy::FifoRelaxed:
+      preferred = {VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+      break;
+    default:
+      break;
   }
 
-  // for (const auto &availablePresentMode : availablePresentModes) {
-  //   if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-  //     std::cout << "Present mode: Immediate" << std::endl;
-  //     return availablePresentMode;
-  //   }
-  // }
+  for (VkPresentModeKHR mode : preferred) {
+    for (const auto &availablePresentMode : availablePresentModes) {
+      if (availablePresentMode == mode) {
+        return availablePresentMode;
+      }
+    }
+  }
 
-  std::cout << "Present mode: V-Sync" << std::endl;
+  // FIFO is the one mode every device has to support.
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+uint32_t Swapchain::chooseImageCount(const VkSurfaceCapabilitiesKHR &capabilities) {
+  uint32_t count = presentSettings.imageCount;
+  if (count == 0) {
+    // Fewer images means fewer frames can queue up for presentation.
+    count = presentSettings.policy == PresentPolicy::LowLatency ? capabilities.minImageCount
+                                                                : capabilities.minImageCount + 1;
+  }
+
+  count = std::max(count, capabilities.minImageCount);
+  if (capabilities.maxImageCount > 0 && count > capabilities.maxImageCount) {
+    count = capabilities.maxImageCount;
+  }
+  return count;
+}
+
 VkExtent2D Swapchain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
   if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
     return capabilities.currentExtent;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "VulkanDevice.hpp"
+#include "FrameResources.hpp"
 
 // vulkan headers
 #include <vulkan/vulkan.h>
@@ -12,12 +13,39 @@
 
 namespace vlkn {
 
+// How frames are handed to the presentation engine. Each policy falls back to FIFO, which every device
+// supports, when its preferred modes are missing:
+// - VSync: FIFO; never tears, but frames queue up behind vertical blanks.
+// - Mailbox: MAILBOX; never tears, and a newer frame replaces one still waiting.
+// - Immediate: IMMEDIATE, then MAILBOX; lowest latency, may tear.
+// - FifoRelaxed: FIFO_RELAXED; like VSync, but a late frame is shown at once and may tear.
+// - LowLatency: MAILBOX with the fewest images the surface allows.
+enum class PresentPolicy { VSync, Mailbox, Immediate, FifoRelaxed, LowLatency };
+constexpr int PRESENT_POLICY_COUNT = 5;
+const char *presentPolicyName(PresentPolicy policy);
+
+struct PresentSettings {
+  PresentPolicy policy = PresentPolicy::Mailbox;
+  // 0 for the policy's default: the surface's minimum for LowLatency, one more than it otherwise.
+  // Clamped to what the surface supports.
+  uint32_t imageCount = 0;
+
+  bool operator==(const PresentSettings &other) const {
+    return policy == other.policy && imageCount == other.imageCount;
+  }
+  bool operator!=(const PresentSettings &other) const { return !(*this == other); }
+};
+
 class Swapchain {
  public:
-  static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-  Swapchain(VulkanDevice &deviceRef, VkExtent2D windowExtent);
-  Swapchain(VulkanDevice& deviceRef, VkExtent2D windowExtent, std::shared_ptr<Swapchain>Previous);
+  // With dynamic rendering no render pass or framebuffers are created; getRenderPass returns null.
+  // When frames uses a timeline, each submit signals its frame number there instead of a fence.
+  Swapchain(VulkanDevice &deviceRef, VkExtent2D windowExtent, FrameResources &frames, const PresentSettings &present,
+      bool useDynamicRendering = false);
+  // Takes over Previous's frames, rendering mode and, if the formats match, render pass; present may differ
+  // from Previous's.
+  Swapchain(VulkanDevice& deviceRef, VkExtent2D windowExtent, std::shared_ptr<Swapchain>Previous,
+      const PresentSettings &present);
   ~Swapchain();
 
   Swapchain(const Swapchain&) = delete;
@@ -26,6 +54,16 @@ class Swapchain {
   VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
   VkRenderPass getRenderPass() { return renderPass; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+  VkImage getImage(int index) { return swapChainImages[index]; }
+  VkImage getDepthImage(int index) { return depthImages[index]; }
+  VkImageView getDepthImageView(int index) { return depthImageViews[index]; }
+  VkFormat getSwapChainDepthFormat() { return swapChainDepthFormat; }
+  bool usesDynamicRendering() const { return dynamicRendering; }
+  const PresentSettings &getPresentSettings() const { return presentSettings; }
+  VkPresentModeKHR getPresentMode() const { return presentMode; }
+  uint32_t getFramesInFlight() const { return static_cast<uint32_t>(imageAvailableSemaphores.size()); }
+  // Recreates the per-frame synchronization objects; the device must be idle.
+  void setFramesInFlight(uint32_t framesInFlight);
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
@@ -45,19 +83,21 @@ class Swapchain {
   };
 
  private:
-     void init();
+     void init(uint32_t framesInFlight);
   void createSwapChain();
   void createImageViews();
   void createDepthResources();
   void createRenderPass();
   void createFramebuffers();
-  void createSyncObjects();
+  void createSyncObjects(uint32_t framesInFlight);
+  void destroySyncObjects();
 
   // Helper functions
   VkSurfaceFormatKHR chooseSwapSurfaceFormat(
       const std::vector<VkSurfaceFormatKHR> &availableFormats);
   VkPresentModeKHR chooseSwapPresentMode(
       const std::vector<VkPresentModeKHR> &availablePresentModes);
+  uint32_t chooseImageCount(const VkSurfaceCapabilitiesKHR &capabilities);
   VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
 
 
@@ -66,24 +106,32 @@ class Swapchain {
   VkExtent2D swapChainExtent;
 
   std::vector<VkFramebuffer> swapChainFramebuffers;
-  VkRenderPass renderPass;
+  VkRenderPass renderPass = VK_NULL_HANDLE;
 
   std::vector<VkImage> depthImages;
-  std::vector<VkDeviceMemory> depthImageMemorys;
+  std::vector<VulkanAllocation> depthImageAllocations;
   std::vector<VkImageView> depthImageViews;
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
 
   VulkanDevice &device;
+  FrameResources &frames;
   VkExtent2D windowExtent;
 
   VkSwapchainKHR swapChain;
   std::shared_ptr<Swapchain> oldSwapchain;
+  bool dynamicRendering = false;
+  PresentSettings presentSettings{};
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
 
   std::vector<VkSemaphore> imageAvailableSemaphores;
+  // One per image, as an image's semaphore is only free again once it has been presented and re-acquired.
   std::vector<VkSemaphore> renderFinishedSemaphores;
+  // Fence path only.
   std::vector<VkFence> inFlightFences;
   std::vector<VkFence> imagesInFlight;
+  // Timeline path only: the frame number last submitted from each frame slot.
+  std::vector<uint64_t> frameTimelineValues;
   size_t currentFrame = 0;
 };
 
@@ -0,0 +1,201 @@
+#include "UploadContext.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace vlkn {
+
+	bool UploadTicket::IsComplete() const
+	{
+		return Context == nullptr || Context->IsComplete(Serial);
+	}
+
+	void UploadTicket::Wait() const
+	{
+		if (Context != nullptr)
+		{
+			Context->Wait(Serial);
+		}
+	}
+
+	UploadContext::UploadContext(VulkanDevice& device, VkDeviceSize stagingSize) : Device{device}, Ring{device, stagingSize}
+	{
+		VkCommandPoolCreateInfo PoolInfo{};
+		PoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		PoolInfo.queueFamilyIndex = Device.findPhysicalQueueFamilies().graphicsFamily;
+		PoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		if (vkCreateCommandPool(Device.device(), &PoolInfo, nullptr, &CommandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Upload Command Pool");
+		}
+	}
+
+	UploadContext::~UploadContext()
+	{
+		if (Recording != VK_NULL_HANDLE)
+		{
+			Submit();
+		}
+		Ring.WaitFor(Ring.GetLastSubmittedSerial());
+		vkDestroyCommandPool(Device.device(), CommandPool, nullptr);
+	}
+
+	/**
+ * Stages data through the ring and records a copy into dstBuffer. Transfers larger than the ring are
+ * split into ring-sized chunks; the open batch is submitted early if a chunk would overwrite it.
+ *
+ * @note Nothing is submitted until Submit() is called (or the ring fills up).
+ */
+	void UploadContext::CopyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+	{
+		const char* Src = static_cast<const char*>(data);
+
+		VkDeviceSize Uploaded = 0;
+		while (Uploaded < size)
+		{
+			VkDeviceSize ChunkSize = std::min(size - Uploaded, Ring.GetCapacity());
+
+			StagingRing::Region Region;
+			if (!Ring.TryReserve(ChunkSize, 16, Region))
+			{
+				Submit();
+				if (!Ring.TryReserve(ChunkSize, 16, Region))
+				{
+					throw std::runtime_error("Failed to Reserve Staging Memory");
+				}
+			}
+
+			memcpy(Region.Mapped, Src + Uploaded, static_cast<size_t>(ChunkSize));
+
+			VkBufferCopy CopyRegion{};
+			CopyRegion.srcOffset = Region.Offset;
+			CopyRegion.dstOffset = dstOffset + Uploaded;
+			CopyRegion.size = ChunkSize;
+			vkCmdCopyBuffer(GetRecordingCommandBuffer(), Region.Buffer, dstBuffer, 1, &CopyRegion);
+
+			Uploaded += ChunkSize;
+		}
+	}
+
+	// Device to device copy, ordered after every transfer recorded or submitted before it.
+	void UploadContext::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, const std::vector<VkBufferCopy>& regions)
+	{
+		if (regions.empty())
+		{
+			return;
+		}
+
+		VkCommandBuffer CommandBuffer = GetRecordingCommandBuffer();
+
+		VkMemoryBarrier Barrier{};
+		Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		Barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &Barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdCopyBuffer(CommandBuffer, srcBuffer, dstBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+	}
+
+	UploadTicket UploadContext::Submit()
+	{
+		if (Recording == VK_NULL_HANDLE)
+		{
+			return UploadTicket{ this, Ring.GetLastSubmittedSerial() };
+		}
+
+		// Make the transfer writes visible to everything submitted after this batch on the queue.
+		VkMemoryBarrier Barrier{};
+		Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		Barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+			VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(Recording, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &Barrier, 0, nullptr, 0, nullptr);
+
+		if (vkEndCommandBuffer(Recording) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Record Upload Command Buffer");
+		}
+
+		StagingRing::Batch Batch = Ring.CloseBatch();
+
+		VkSubmitInfo SubmitInfo{};
+		SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		SubmitInfo.commandBufferCount = 1;
+		SubmitInfo.pCommandBuffers = &Recording;
+
+		if (vkQueueSubmit(Device.graphicsQueue(), 1, &SubmitInfo, Batch.Fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Submit Upload Command Buffer");
+		}
+
+		Pending.push_back({ Batch.Serial, Recording });
+		Recording = VK_NULL_HANDLE;
+		return UploadTicket{ this, Batch.Serial };
+	}
+
+	bool UploadContext::IsComplete(uint64_t serial)
+	{
+		bool Complete = Ring.IsComplete(serial);
+		RecycleCommandBuffers();
+		return Complete;
+	}
+
+	void UploadContext::Wait(uint64_t serial)
+	{
+		Ring.WaitFor(serial);
+		RecycleCommandBuffers();
+	}
+
+	VkCommandBuffer UploadContext::GetRecordingCommandBuffer()
+	{
+		if (Recording != VK_NULL_HANDLE)
+		{
+			return Recording;
+		}
+
+		RecycleCommandBuffers();
+		if (!FreeCommandBuffers.empty())
+		{
+			Recording = FreeCommandBuffers.back();
+			FreeCommandBuffers.pop_back();
+		}
+		else
+		{
+			VkCommandBufferAllocateInfo AllocInfo{};
+			AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			AllocInfo.commandPool = CommandPool;
+			AllocInfo.commandBufferCount = 1;
+
+			if (vkAllocateCommandBuffers(Device.device(), &AllocInfo, &Recording) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to Allocate Upload Command Buffer");
+			}
+		}
+
+		VkCommandBufferBeginInfo BeginInfo{};
+		BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (vkBeginCommandBuffer(Recording, &BeginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Begin Upload Command Buffer");
+		}
+		return Recording;
+	}
+
+	void UploadContext::RecycleCommandBuffers()
+	{
+		while (!Pending.empty() && Ring.IsComplete(Pending.front().Serial))
+		{
+			FreeCommandBuffers.push_back(Pending.front().CommandBuffer);
+			Pending.pop_front();
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+#include "StagingRing.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace vlkn {
+	class UploadContext;
+
+	// Handle to a submitted batch of uploads. A default constructed ticket is always complete.
+	class UploadTicket {
+	public:
+		UploadTicket() = default;
+
+		bool IsComplete() const;
+		void Wait() const;
+		uint64_t GetSerial() const { return Serial; }
+
+	private:
+		friend class UploadContext;
+		UploadTicket(UploadContext* context, uint64_t serial) : Context{context}, Serial{serial} {}
+
+		UploadContext* Context = nullptr;
+		uint64_t Serial = 0;
+	};
+
+	// Records staging copies into its own command buffers and submits them with a fence instead of
+	// draining the queue. Copies are visible to vertex/index/uniform reads in any later submission.
+	class UploadContext {
+	public:
+		UploadContext(VulkanDevice& device, VkDeviceSize stagingSize = StagingRing::DEFAULT_SIZE);
+		~UploadContext();
+
+		UploadContext(const UploadContext&) = delete;
+		UploadContext& operator=(const UploadContext&) = delete;
+
+		void CopyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+		void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, const std::vector<VkBufferCopy>& regions);
+		UploadTicket Submit();
+
+		bool IsComplete(uint64_t serial);
+		void Wait(uint64_t serial);
+
+		// Number of batches submitted so far; serials are handed out in the same sequence.
+		uint64_t GetSubmitCount() const { return Ring.GetLastSubmittedSerial(); }
+
+	private:
+		VkCommandBuffer GetRecordingCommandBuffer();
+		void RecycleCommandBuffers();
+
+		VulkanDevice& Device;
+		StagingRing Ring;
+		VkCommandPool CommandPool = VK_NULL_HANDLE;
+		VkCommandBuffer Recording = VK_NULL_HANDLE;
+
+		struct PendingSubmit {
+			uint64_t Serial;
+			VkCommandBuffer CommandBuffer;
+		};
+		std::deque<PendingSubmit> Pending;
+		std::vector<VkCommandBuffer> FreeCommandBuffers;
+	};
+}
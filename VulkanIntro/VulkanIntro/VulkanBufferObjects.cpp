@@ -34,19 +34,20 @@ namespace vlkn {
 	{
 		AlignmentSize = GetAlignment(InstanceSize, minOffsetAlignment);
 		BufferSize = AlignmentSize * InstanceCount;
-		Device.createBuffer(BufferSize, UsageFlags, MemoryPropertyFlags, Buffer, Memory);
+		Device.createBuffer(BufferSize, UsageFlags, MemoryPropertyFlags, Buffer, Allocation);
 	}
 
 	VulkanBufferObjects::~VulkanBufferObjects()
 	{
 		Unmap();
-		vkDestroyBuffer(Device.device(), Buffer, nullptr);
-		vkFreeMemory(Device.device(), Memory, nullptr);
+		Device.destroyBuffer(Buffer, Allocation);
 	}
 
 	/**
  * Map a memory range of this buffer. If successful, mapped points to the specified buffer range.
  *
+ * @note Host-visible memory is persistently mapped by the allocator, so this only hands out a pointer.
+ *
  * @param size (Optional) Size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete
  * buffer range.
  * @param offset (Optional) Byte offset from beginning
@@ -55,8 +56,13 @@ namespace vlkn {
  */
 	VkResult VulkanBufferObjects::Map(VkDeviceSize size, VkDeviceSize offset)
 	{
-		assert(Buffer && Memory && "Called Map on Buffer Before Creating the Buffer.");
-		return vkMapMemory(Device.device(), Memory, offset, size, 0, &Mapped);
+		assert(Buffer && Allocation.Memory && "Called Map on Buffer Before Creating the Buffer.");
+		if (Allocation.Mapped == nullptr)
+		{
+			return VK_ERROR_MEMORY_MAP_FAILED;
+		}
+		Mapped = static_cast<char*>(Allocation.Mapped) + offset;
+		return VK_SUCCESS;
 	}
 
 	/**
@@ -66,11 +72,7 @@ namespace vlkn {
  */
 	void VulkanBufferObjects::Unmap()
 	{
-		if (Mapped)
-		{
-			vkUnmapMemory(Device.device(), Memory);
-			Mapped = nullptr;
-		}
+		Mapped = nullptr;
 	}
 
 	/**
@@ -112,12 +114,7 @@ namespace vlkn {
 
 	VkResult VulkanBufferObjects::Flush(VkDeviceSize size, VkDeviceSize offset)
 	{
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = Memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
-		return vkFlushMappedMemoryRanges(Device.device(), 1, &mappedRange);
+		return Device.memoryAllocator().Flush(Allocation, size, offset);
 	}
 
 	/**
@@ -148,12 +145,7 @@ namespace vlkn {
  */
 	VkResult VulkanBufferObjects::Invalidate(VkDeviceSize size, VkDeviceSize offset)
 	{
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = Memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
-		return vkInvalidateMappedMemoryRanges(Device.device(), 1, &mappedRange);
+		return Device.memoryAllocator().Invalidate(Allocation, size, offset);
 	}
 
 	/**
@@ -40,7 +40,7 @@ namespace vlkn {
 		VulkanDevice& Device;
 		void* Mapped = nullptr;
 		VkBuffer Buffer = VK_NULL_HANDLE;
-		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		VulkanAllocation Allocation{};
 
 		VkDeviceSize BufferSize;
 		uint32_t InstanceCount;
@@ -1,6 +1,8 @@
 #include "VulkanDescriptors.hpp"
+#include "VulkanLayoutCache.hpp"
 
 
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
@@ -20,8 +22,8 @@ namespace vlkn {
 		return *this;
 	}
 
-	std::unique_ptr<VulkanDescriptorSetLayout> VulkanDescriptorSetLayout::Builder::Build() const {
-		return std::make_unique<VulkanDescriptorSetLayout>(Device, Bindings);
+	std::shared_ptr<VulkanDescriptorSetLayout> VulkanDescriptorSetLayout::Builder::Build() const {
+		return Device.layoutCache().GetDescriptorSetLayout(Bindings);
 	}
 
 
@@ -120,8 +122,146 @@ namespace vlkn {
 		vkResetDescriptorPool(Device.device(), DescriptorPool, 0);
 	}
 
+	VulkanDescriptorAllocator::VulkanDescriptorAllocator(VulkanDevice& device, uint32_t setsPerPool, std::vector<PoolSizeRatio> poolRatios) :
+		Device{device}, PoolRatios{std::move(poolRatios)}, SetsPerPool{setsPerPool}
+	{
+	}
+
+	VulkanDescriptorAllocator::~VulkanDescriptorAllocator()
+	{
+		if (CurrentPool != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorPool(Device.device(), CurrentPool, nullptr);
+		}
+		for (auto Pool : FullPools)
+		{
+			vkDestroyDescriptorPool(Device.device(), Pool, nullptr);
+		}
+		for (auto Pool : ReadyPools)
+		{
+			vkDestroyDescriptorPool(Device.device(), Pool, nullptr);
+		}
+	}
+
+	std::vector<VulkanDescriptorAllocator::PoolSizeRatio> VulkanDescriptorAllocator::DefaultPoolRatios()
+	{
+		return {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f },
+		};
+	}
+
+	/**
+ * Allocates a set from the current pool, moving on to a new pool if it is exhausted or fragmented.
+ *
+ * @return false only if a freshly created pool cannot hold the set either (e.g. the layout needs a
+ * descriptor type missing from the pool ratios). Other errors throw.
+ */
+	bool VulkanDescriptorAllocator::AllocateDescriptorSet(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptor)
+	{
+		bool FreshPool = CurrentPool == VK_NULL_HANDLE;
+		if (FreshPool)
+		{
+			CurrentPool = AcquirePool();
+		}
+
+		VkDescriptorSetAllocateInfo AllocInfo{};
+		AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		AllocInfo.pSetLayouts = &descriptorSetLayout;
+		AllocInfo.descriptorSetCount = 1;
+
+		while (true)
+		{
+			AllocInfo.descriptorPool = CurrentPool;
+			VkResult Result = vkAllocateDescriptorSets(Device.device(), &AllocInfo, &descriptor);
+			if (Result == VK_SUCCESS)
+			{
+				AllocatorStats.SetsAllocated++;
+				return true;
+			}
+			if (Result != VK_ERROR_OUT_OF_POOL_MEMORY && Result != VK_ERROR_FRAGMENTED_POOL)
+			{
+				throw std::runtime_error("Failed to Allocate Descriptor Set");
+			}
+			// The set doesn't fit even a fresh pool, which stays current for the sets that do.
+			if (FreshPool)
+			{
+				return false;
+			}
+
+			FullPools.push_back(CurrentPool);
+			CurrentPool = AcquirePool();
+			FreshPool = true;
+		}
+	}
+
+	// Returns every set handed out since the last reset to the pools. Only call once no submitted work
+	// still uses them.
+	void VulkanDescriptorAllocator::Reset()
+	{
+		if (CurrentPool != VK_NULL_HANDLE)
+		{
+			FullPools.push_back(CurrentPool);
+			CurrentPool = VK_NULL_HANDLE;
+		}
+		for (auto Pool : FullPools)
+		{
+			vkResetDescriptorPool(Device.device(), Pool, 0);
+			ReadyPools.push_back(Pool);
+		}
+		FullPools.clear();
+		AllocatorStats.PoolsInUse = 0;
+		AllocatorStats.Resets++;
+	}
+
+	VkDescriptorPool VulkanDescriptorAllocator::AcquirePool()
+	{
+		AllocatorStats.PoolsInUse++;
+		if (!ReadyPools.empty())
+		{
+			VkDescriptorPool Pool = ReadyPools.back();
+			ReadyPools.pop_back();
+			return Pool;
+		}
+
+		VkDescriptorPool Pool = CreatePool(SetsPerPool);
+		// Grow the next pool so a workload that keeps overflowing settles on a few large pools.
+		SetsPerPool = std::min(SetsPerPool + SetsPerPool / 2, MAX_SETS_PER_POOL);
+		return Pool;
+	}
+
+	VkDescriptorPool VulkanDescriptorAllocator::CreatePool(uint32_t setCount)
+	{
+		std::vector<VkDescriptorPoolSize> PoolSizes;
+		for (auto& Ratio : PoolRatios)
+		{
+			PoolSizes.push_back({ Ratio.Type, std::max(1u, static_cast<uint32_t>(Ratio.Ratio * setCount)) });
+		}
+
+		VkDescriptorPoolCreateInfo DescriptorPoolInfo{};
+		DescriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		DescriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(PoolSizes.size());
+		DescriptorPoolInfo.pPoolSizes = PoolSizes.data();
+		DescriptorPoolInfo.maxSets = setCount;
+
+		VkDescriptorPool Pool;
+		if (vkCreateDescriptorPool(Device.device(), &DescriptorPoolInfo, nullptr, &Pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Descriptor Pool.");
+		}
+		AllocatorStats.PoolsCreated++;
+		return Pool;
+	}
+
 	VulkanDescriptorWriter::VulkanDescriptorWriter(VulkanDescriptorSetLayout& setLayout, VulkanDescriptorPool& pool):
-		SetLayout{setLayout}, Pool{pool}
+		SetLayout{setLayout}, Pool{&pool}
+	{
+	}
+
+	VulkanDescriptorWriter::VulkanDescriptorWriter(VulkanDescriptorSetLayout& setLayout, VulkanDescriptorAllocator& allocator) :
+		SetLayout{ setLayout }, Allocator{ &allocator }
 	{
 	}
 
@@ -166,7 +306,9 @@ namespace vlkn {
 
 	bool VulkanDescriptorWriter::Build(VkDescriptorSet& set)
 	{
-		bool success = Pool.AllocateDescriptorSet(SetLayout.GetDescriptorSetLayout(), set);
+		bool success = Pool != nullptr
+			? Pool->AllocateDescriptorSet(SetLayout.GetDescriptorSetLayout(), set)
+			: Allocator->AllocateDescriptorSet(SetLayout.GetDescriptorSetLayout(), set);
 		if (!success) {
 			return false;
 		}
@@ -179,7 +321,7 @@ namespace vlkn {
 		for (auto& write : Writes) {
 			write.dstSet = set;
 		}
-		vkUpdateDescriptorSets(Pool.Device.device(), Writes.size(), Writes.data(), 0, nullptr);
+		vkUpdateDescriptorSets(SetLayout.Device.device(), Writes.size(), Writes.data(), 0, nullptr);
 	}
 
 }
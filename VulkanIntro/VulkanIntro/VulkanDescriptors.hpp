@@ -14,7 +14,8 @@ public:
 		Builder(VulkanDevice &device):Device{device}{}
 
 		Builder& AddBinding( uint32_t binding, VkDescriptorType descriptorType, VkShaderStageFlags stageFlags, uint32_t count = 1);
-		std::unique_ptr<VulkanDescriptorSetLayout> Build() const;
+		// Identical binding sets return the same cached layout; see VulkanLayoutCache.
+		std::shared_ptr<VulkanDescriptorSetLayout> Build() const;
 	private:
 		VulkanDevice& Device;
 		std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> Bindings{};
@@ -71,9 +72,57 @@ private:
 	friend class VulkanDescriptorWriter;
 };
 
+// Hands out descriptor sets from a growing list of pools. When a pool runs out a new, larger one is created
+// transparently. Reset() recycles every pool at once, so an allocator per frame in flight can serve
+// transient sets that are rebuilt each frame.
+class VulkanDescriptorAllocator {
+public:
+	struct PoolSizeRatio {
+		VkDescriptorType Type;
+		float Ratio;
+	};
+
+	struct Stats {
+		uint64_t SetsAllocated = 0;
+		uint32_t PoolsCreated = 0;
+		uint32_t PoolsInUse = 0;
+		uint32_t Resets = 0;
+	};
+
+	static constexpr uint32_t DEFAULT_SETS_PER_POOL = 64;
+	static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+	VulkanDescriptorAllocator(VulkanDevice& device, uint32_t setsPerPool = DEFAULT_SETS_PER_POOL,
+		std::vector<PoolSizeRatio> poolRatios = DefaultPoolRatios());
+	~VulkanDescriptorAllocator();
+
+	VulkanDescriptorAllocator(const VulkanDescriptorAllocator&) = delete;
+	VulkanDescriptorAllocator& operator=(const VulkanDescriptorAllocator&) = delete;
+
+	bool AllocateDescriptorSet(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptor);
+	void Reset();
+
+	const Stats& GetStats() const { return AllocatorStats; }
+
+	static std::vector<PoolSizeRatio> DefaultPoolRatios();
+
+private:
+	VkDescriptorPool AcquirePool();
+	VkDescriptorPool CreatePool(uint32_t setCount);
+
+	VulkanDevice& Device;
+	std::vector<PoolSizeRatio> PoolRatios;
+	uint32_t SetsPerPool;
+	VkDescriptorPool CurrentPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPool> FullPools;
+	std::vector<VkDescriptorPool> ReadyPools;
+	Stats AllocatorStats{};
+};
+
 class VulkanDescriptorWriter {
 public:
 	VulkanDescriptorWriter(VulkanDescriptorSetLayout& setLayout, VulkanDescriptorPool& pool);
+	VulkanDescriptorWriter(VulkanDescriptorSetLayout& setLayout, VulkanDescriptorAllocator& allocator);
 
 	VulkanDescriptorWriter& WriteBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo);
 	VulkanDescriptorWriter& WriteImage(uint32_t binding, VkDescriptorImageInfo* imageInfo);
@@ -83,7 +132,8 @@ public:
 
 private:
 	VulkanDescriptorSetLayout& SetLayout;
-	VulkanDescriptorPool& Pool;
+	VulkanDescriptorPool* Pool = nullptr;
+	VulkanDescriptorAllocator* Allocator = nullptr;
 	std::vector<VkWriteDescriptorSet> Writes;
 };
 
@@ -1,7 +1,14 @@
 #include "VulkanDevice.hpp"
+#include "UploadContext.hpp"
+#include "VulkanLayoutCache.hpp"
+#include "ShaderModuleCache.hpp"
 
 // std headers
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
@@ -47,16 +54,27 @@ void DestroyDebugUtilsMessengerEXT(
 }
 
 // class member functions
-VulkanDevice::VulkanDevice(Window &window) : window{window} {
+VulkanDevice::VulkanDevice(Window &window, VkDeviceSize stagingRingSize) : window{window} {
   createInstance();
   setupDebugMessenger();
   createSurface();
   pickPhysicalDevice();
   createLogicalDevice();
   createCommandPool();
+  createMemoryAllocator();
+  createUploadContext(stagingRingSize);
+  createLayoutCache();
+  createShaderModuleCache();
+  createPipelineCache();
 }
 
 VulkanDevice::~VulkanDevice() {
+  savePipelineCache();
+  vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
+  shaderModuleCache_.reset();
+  layoutCache_.reset();
+  uploadContext_.reset();
+  allocator_.reset();
   vkDestroyCommandPool(device_, commandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
 
@@ -79,7 +97,8 @@ void VulkanDevice::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  // The highest version the engine knows about; optional features check the device's own version.
+  appInfo.apiVersion = VK_API_VERSION_1_3;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -149,8 +168,124 @@ void VulkanDevice::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
-  VkPhysicalDeviceFeatures deviceFeatures = {};
-  deviceFeatures.samplerAnisotropy = VK_TRUE;
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+  enabledFeatures_ = {};
+  enabledFeatures_.samplerAnisotropy = VK_TRUE;
+  enabledFeatures_.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+  enabledFeatures_.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(
+      physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+  enabledExtensions_ = deviceExtensions;
+  for (const char *optional : optionalDeviceExtensions) {
+    for (const auto &extension : availableExtensions) {
+      if (strcmp(optional, extension.extensionName) == 0) {
+        enabledExtensions_.push_back(optional);
+        break;
+      }
+    }
+  }
+
+  // Optional features are queried in one chain; extensions whose feature bit is missing are dropped.
+  // vkGetPhysicalDeviceFeatures2 is core from 1.1, the 1.3 feature struct is only valid on a 1.3 device.
+  maintenance5Features_ = {};
+  maintenance5Features_.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+  graphicsPipelineLibraryFeatures_ = {};
+  graphicsPipelineLibraryFeatures_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+  maintenance5Features_.pNext = &graphicsPipelineLibraryFeatures_;
+  extendedDynamicState3Features_ = {};
+  extendedDynamicState3Features_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+  graphicsPipelineLibraryFeatures_.pNext = &extendedDynamicState3Features_;
+  vulkan13Features_ = {};
+  vulkan13Features_.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  if (properties.apiVersion >= VK_API_VERSION_1_3) {
+    extendedDynamicState3Features_.pNext = &vulkan13Features_;
+  }
+  VkPhysicalDeviceFeatures2 features2{};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &maintenance5Features_;
+  if (properties.apiVersion >= VK_API_VERSION_1_1) {
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+  }
+
+  auto dropExtension = [this](const char *extensionName) {
+    auto it = std::find_if(
+        enabledExtensions_.begin(), enabledExtensions_.end(), [extensionName](const char *name) {
+          return strcmp(name, extensionName) == 0;
+        });
+    if (it != enabledExtensions_.end()) {
+      enabledExtensions_.erase(it);
+    }
+  };
+  // maintenance5 depends on dynamic rendering, which is only enabled through a 1.3 device.
+  if (!maintenance5Features_.maintenance5 || properties.apiVersion < VK_API_VERSION_1_3) {
+    dropExtension(VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+  }
+  // VK_EXT_graphics_pipeline_library is built on VK_KHR_pipeline_library, so both go together.
+  if (!graphicsPipelineLibraryFeatures_.graphicsPipelineLibrary ||
+      !isExtensionEnabled(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+    dropExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+  }
+  if (!isExtensionEnabled(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+    dropExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+  }
+
+  // Of extended dynamic state 3 only polygon mode is used.
+  if (!extendedDynamicState3Features_.extendedDynamicState3PolygonMode) {
+    dropExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+  }
+  extendedDynamicState3Features_ = {};
+  extendedDynamicState3Features_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+  extendedDynamicState3Features_.extendedDynamicState3PolygonMode = VK_TRUE;
+
+  // Extended dynamic state 1 and 2 are core in 1.3 and need no feature bits there.
+  extendedDynamicStateEnabled_ = properties.apiVersion >= VK_API_VERSION_1_3;
+
+  // Of the core 1.3 features only dynamic rendering is used.
+  dynamicRenderingEnabled_ = vulkan13Features_.dynamicRendering == VK_TRUE;
+  vulkan13Features_ = {};
+  vulkan13Features_.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  vulkan13Features_.dynamicRendering = dynamicRenderingEnabled_ ? VK_TRUE : VK_FALSE;
+
+  // Timeline semaphores are a required feature of 1.2. With the 1.2 struct in the chain, drawIndirectCount
+  // has to match the extension.
+  timelineSemaphoreEnabled_ = properties.apiVersion >= VK_API_VERSION_1_2;
+  vulkan12Features_ = {};
+  vulkan12Features_.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  vulkan12Features_.timelineSemaphore = VK_TRUE;
+  vulkan12Features_.drawIndirectCount =
+      isExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) ? VK_TRUE : VK_FALSE;
+
+  // Only the structs of enabled extensions go into the device's pNext chain.
+  void *featureChain = nullptr;
+  if (timelineSemaphoreEnabled_) {
+    featureChain = &vulkan12Features_;
+  }
+  if (properties.apiVersion >= VK_API_VERSION_1_3) {
+    vulkan13Features_.pNext = featureChain;
+    featureChain = &vulkan13Features_;
+  }
+  if (isExtensionEnabled(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+    extendedDynamicState3Features_.pNext = featureChain;
+    featureChain = &extendedDynamicState3Features_;
+  }
+  if (isExtensionEnabled(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+    graphicsPipelineLibraryFeatures_.pNext = featureChain;
+    featureChain = &graphicsPipelineLibraryFeatures_;
+  }
+  if (isExtensionEnabled(VK_KHR_MAINTENANCE_5_EXTENSION_NAME)) {
+    maintenance5Features_.pNext = featureChain;
+    featureChain = &maintenance5Features_;
+  }
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -158,9 +293,10 @@ void VulkanDevice::createLogicalDevice() {
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-  createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  createInfo.pEnabledFeatures = &enabledFeatures_;
+  createInfo.pNext = featureChain;
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions_.size());
+  createInfo.ppEnabledExtensionNames = enabledExtensions_.data();
 
   // might not really be necessary anymore because device specific validation layers
   // have been deprecated
@@ -179,6 +315,15 @@ void VulkanDevice::createLogicalDevice() {
   vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
 }
 
+bool VulkanDevice::isExtensionEnabled(const char *extensionName) const {
+  for (const char *enabled : enabledExtensions_) {
+    if (strcmp(enabled, extensionName) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void VulkanDevice::createCommandPool() {
   QueueFamilyIndices queueFamilyIndices = findPhysicalQueueFamilies();
 
@@ -193,6 +338,106 @@ void VulkanDevice::createCommandPool() {
   }
 }
 
+void VulkanDevice::createMemoryAllocator() {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+  allocator_ = std::make_unique<VulkanMemoryAllocator>(device_, memProperties, properties.limits);
+}
+
+void VulkanDevice::createUploadContext(VkDeviceSize stagingSize) {
+  uploadContext_ = std::make_unique<UploadContext>(*this, stagingSize);
+}
+
+void VulkanDevice::createLayoutCache() { layoutCache_ = std::make_unique<VulkanLayoutCache>(*this); }
+
+void VulkanDevice::createShaderModuleCache() {
+  shaderModuleCache_ = std::make_unique<ShaderModuleCache>(*this);
+}
+
+void VulkanDevice::createPipelineCache() {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  std::vector<char> data;
+  std::ifstream file{PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary};
+  if (file.is_open()) {
+    data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(data.data(), data.size());
+  }
+
+  pipelineCacheWarm_ = !data.empty() && isPipelineCacheCompatible(data);
+  if (!pipelineCacheWarm_) {
+    data.clear();
+  }
+
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = data.size();
+  cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+  if (vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipelineCache_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+
+  float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(
+                 std::chrono::high_resolution_clock::now() - start)
+                 .count();
+  std::cout << "Pipeline cache: " << (pipelineCacheWarm_ ? "hit, " : "miss, ") << data.size()
+            << " bytes loaded in " << ms << " ms" << std::endl;
+}
+
+// The driver rejects foreign data on its own, but an explicit check lets us report why and start
+// cold instead of relying on that.
+bool VulkanDevice::isPipelineCacheCompatible(const std::vector<char> &data) {
+  VkPipelineCacheHeaderVersionOne header{};
+  if (data.size() < sizeof(header)) {
+    std::cout << "Pipeline cache: file truncated, ignoring" << std::endl;
+    return false;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+
+  if (header.headerSize < sizeof(header) ||
+      header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+    std::cout << "Pipeline cache: unknown header, ignoring" << std::endl;
+    return false;
+  }
+  if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+      memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    std::cout << "Pipeline cache: written by a different device or driver, ignoring" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Written to a temporary file and renamed over the old one, so a crash mid-write never leaves a
+// truncated cache behind.
+void VulkanDevice::savePipelineCache() {
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device_, pipelineCache_, &size, nullptr) != VK_SUCCESS || size == 0) {
+    return;
+  }
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device_, pipelineCache_, &size, data.data()) != VK_SUCCESS) {
+    return;
+  }
+
+  std::string tempPath = std::string(PIPELINE_CACHE_PATH) + ".tmp";
+  {
+    std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+    if (!file.write(data.data(), size)) {
+      std::cerr << "failed to write pipeline cache" << std::endl;
+      return;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, PIPELINE_CACHE_PATH, error);
+  if (error) {
+    std::cerr << "failed to replace pipeline cache: " << error.message() << std::endl;
+    std::filesystem::remove(tempPath, error);
+  }
+}
+
 void VulkanDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
 
 bool VulkanDevice::isDeviceSuitable(VkPhysicalDevice device) {
@@ -408,7 +653,7 @@ void VulkanDevice::createBuffer(
     VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties,
     VkBuffer &buffer,
-    VkDeviceMemory &bufferMemory) {
+    VulkanAllocation &bufferAllocation) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
@@ -422,16 +667,28 @@ void VulkanDevice::createBuffer(
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+  try {
+    bufferAllocation = allocator_->Allocate(
+        memRequirements,
+        properties,
+        VulkanMemoryAllocator::ResourceKind::Linear);
+  } catch (...) {
+    vkDestroyBuffer(device_, buffer, nullptr);
+    buffer = VK_NULL_HANDLE;
+    throw;
+  }
 
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate vertex buffer memory!");
+  if (vkBindBufferMemory(device_, buffer, bufferAllocation.Memory, bufferAllocation.Offset) !=
+      VK_SUCCESS) {
+    destroyBuffer(buffer, bufferAllocation);
+    buffer = VK_NULL_HANDLE;
+    throw std::runtime_error("failed to bind vertex buffer memory!");
   }
+}
 
-  vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+void VulkanDevice::destroyBuffer(VkBuffer buffer, VulkanAllocation &bufferAllocation) {
+  vkDestroyBuffer(device_, buffer, nullptr);
+  allocator_->Free(bufferAllocation);
 }
 
 VkCommandBuffer VulkanDevice::beginSingleTimeCommands() {
@@ -460,8 +717,17 @@ void VulkanDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue_);
+  // wait on a fence for this submission only, rather than draining the queue with vkQueueWaitIdle
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  VkFence fence;
+  if (vkCreateFence(device_, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create single time command fence!");
+  }
+
+  vkQueueSubmit(graphicsQueue_, 1, &submitInfo, fence);
+  vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+  vkDestroyFence(device_, fence, nullptr);
 
   vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
 }
@@ -478,6 +744,13 @@ void VulkanDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSi
   endSingleTimeCommands(commandBuffer);
 }
 
+// Blocking convenience wrapper; prefer uploadContext() and an UploadTicket on hot paths.
+void VulkanDevice::uploadToBuffer(
+    const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+  uploadContext_->CopyToBuffer(data, size, dstBuffer, dstOffset);
+  uploadContext_->Submit().Wait();
+}
+
 void VulkanDevice::copyBufferToImage(
     VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount) {
   VkCommandBuffer commandBuffer = beginSingleTimeCommands();
@@ -509,7 +782,7 @@ void VulkanDevice::createImageWithInfo(
     const VkImageCreateInfo &imageInfo,
     VkMemoryPropertyFlags properties,
     VkImage &image,
-    VkDeviceMemory &imageMemory) {
+    VulkanAllocation &imageAllocation) {
   if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
     throw std::runtime_error("failed to create image!");
   }
@@ -517,18 +790,29 @@ void VulkanDevice::createImageWithInfo(
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
+  try {
+    imageAllocation = allocator_->Allocate(
+        memRequirements,
+        properties,
+        imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? VulkanMemoryAllocator::ResourceKind::Optimal
+                                                    : VulkanMemoryAllocator::ResourceKind::Linear);
+  } catch (...) {
+    vkDestroyImage(device_, image, nullptr);
+    image = VK_NULL_HANDLE;
+    throw;
   }
 
-  if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+  if (vkBindImageMemory(device_, image, imageAllocation.Memory, imageAllocation.Offset) !=
+      VK_SUCCESS) {
+    destroyImage(image, imageAllocation);
+    image = VK_NULL_HANDLE;
     throw std::runtime_error("failed to bind image memory!");
   }
 }
 
+void VulkanDevice::destroyImage(VkImage image, VulkanAllocation &imageAllocation) {
+  vkDestroyImage(device_, image, nullptr);
+  allocator_->Free(imageAllocation);
+}
+
 }  // namespace lve
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "Window.hpp"
+#include "VulkanMemoryAllocator.hpp"
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -22,6 +24,10 @@ struct QueueFamilyIndices {
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 };
 
+class UploadContext;
+class VulkanLayoutCache;
+class ShaderModuleCache;
+
 class VulkanDevice {
  public:
 #ifdef NDEBUG
@@ -30,7 +36,10 @@ class VulkanDevice {
   const bool enableValidationLayers = true;
 #endif
 
-  VulkanDevice(Window &window);
+  static constexpr VkDeviceSize DEFAULT_STAGING_RING_SIZE = 16ull * 1024 * 1024;
+  static constexpr const char *PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+  VulkanDevice(Window &window, VkDeviceSize stagingRingSize = DEFAULT_STAGING_RING_SIZE);
   ~VulkanDevice();
 
   // Not copyable or movable
@@ -44,6 +53,8 @@ class VulkanDevice {
   VkSurfaceKHR surface() { return surface_; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
   VkQueue presentQueue() { return presentQueue_; }
+  VkPipelineCache pipelineCache() { return pipelineCache_; }
+  bool pipelineCacheWarm() const { return pipelineCacheWarm_; }
 
   SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -57,10 +68,13 @@ class VulkanDevice {
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
       VkBuffer &buffer,
-      VkDeviceMemory &bufferMemory);
+      VulkanAllocation &bufferAllocation);
+  void destroyBuffer(VkBuffer buffer, VulkanAllocation &bufferAllocation);
   VkCommandBuffer beginSingleTimeCommands();
   void endSingleTimeCommands(VkCommandBuffer commandBuffer);
   void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+  void uploadToBuffer(
+      const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
   void copyBufferToImage(
       VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
@@ -68,7 +82,25 @@ class VulkanDevice {
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
       VkImage &image,
-      VkDeviceMemory &imageMemory);
+      VulkanAllocation &imageAllocation);
+  void destroyImage(VkImage image, VulkanAllocation &imageAllocation);
+
+  // Optional extensions and features are enabled only when the physical device supports them.
+  bool isExtensionEnabled(const char *extensionName) const;
+  const VkPhysicalDeviceFeatures &enabledFeatures() const { return enabledFeatures_; }
+  bool dynamicRenderingEnabled() const { return dynamicRenderingEnabled_; }
+  // Cull mode, front face, topology, depth test/write/compare and depth bias enable can be set per draw.
+  bool extendedDynamicStateEnabled() const { return extendedDynamicStateEnabled_; }
+  bool timelineSemaphoreEnabled() const { return timelineSemaphoreEnabled_; }
+  bool dynamicPolygonModeEnabled() const {
+    return isExtensionEnabled(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+  }
+
+  VulkanMemoryAllocator &memoryAllocator() { return *allocator_; }
+  UploadContext &uploadContext() { return *uploadContext_; }
+  VulkanLayoutCache &layoutCache() { return *layoutCache_; }
+  ShaderModuleCache &shaderModuleCache() { return *shaderModuleCache_; }
+  VulkanMemoryStats getMemoryStats() const { return allocator_->GetStats(); }
 
   VkPhysicalDeviceProperties properties;
 
@@ -79,6 +111,13 @@ class VulkanDevice {
   void pickPhysicalDevice();
   void createLogicalDevice();
   void createCommandPool();
+  void createMemoryAllocator();
+  void createUploadContext(VkDeviceSize stagingSize);
+  void createLayoutCache();
+  void createShaderModuleCache();
+  void createPipelineCache();
+  void savePipelineCache();
+  bool isPipelineCacheCompatible(const std::vector<char> &data);
 
   // helper functions
   bool isDeviceSuitable(VkPhysicalDevice device);
@@ -100,9 +139,31 @@ class VulkanDevice {
   VkSurfaceKHR surface_;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
+  std::unique_ptr<VulkanMemoryAllocator> allocator_;
+  std::unique_ptr<UploadContext> uploadContext_;
+  std::unique_ptr<VulkanLayoutCache> layoutCache_;
+  std::unique_ptr<ShaderModuleCache> shaderModuleCache_;
+  VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+  bool pipelineCacheWarm_ = false;
 
   const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
   const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  const std::vector<const char *> optionalDeviceExtensions = {
+      VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+      VK_KHR_MAINTENANCE_5_EXTENSION_NAME,
+      VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+      VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+      VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME};
+  std::vector<const char *> enabledExtensions_;
+  VkPhysicalDeviceFeatures enabledFeatures_{};
+  VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5Features_{};
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures_{};
+  VkPhysicalDeviceVulkan12Features vulkan12Features_{};
+  VkPhysicalDeviceVulkan13Features vulkan13Features_{};
+  VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features_{};
+  bool dynamicRenderingEnabled_ = false;
+  bool extendedDynamicStateEnabled_ = false;
+  bool timelineSemaphoreEnabled_ = false;
 };
 
 }  // namespace lve
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "VulkanLayoutCache.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace vlkn {
+
+	bool VulkanLayoutCache::SetLayoutKey::operator==(const SetLayoutKey& other) const
+	{
+		return std::equal(Bindings.begin(), Bindings.end(), other.Bindings.begin(), other.Bindings.end(),
+			[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+				return a.binding == b.binding && a.descriptorType == b.descriptorType &&
+					a.descriptorCount == b.descriptorCount && a.stageFlags == b.stageFlags &&
+					a.pImmutableSamplers == b.pImmutableSamplers;
+			});
+	}
+
+	bool VulkanLayoutCache::PipelineLayoutKey::operator==(const PipelineLayoutKey& other) const
+	{
+		return SetLayouts == other.SetLayouts &&
+			std::equal(PushConstantRanges.begin(), PushConstantRanges.end(),
+				other.PushConstantRanges.begin(), other.PushConstantRanges.end(),
+				[](const VkPushConstantRange& a, const VkPushConstantRange& b) {
+					return a.stageFlags == b.stageFlags && a.offset == b.offset && a.size == b.size;
+				});
+	}
+
+	size_t VulkanLayoutCache::KeyHash::operator()(const SetLayoutKey& key) const
+	{
+		size_t Seed = 0;
+		for (const auto& Binding : key.Bindings)
+		{
+			hashCombine(Seed, Binding.binding, static_cast<uint32_t>(Binding.descriptorType), Binding.descriptorCount,
+				static_cast<uint32_t>(Binding.stageFlags), Binding.pImmutableSamplers);
+		}
+		return Seed;
+	}
+
+	size_t VulkanLayoutCache::KeyHash::operator()(const PipelineLayoutKey& key) const
+	{
+		size_t Seed = 0;
+		for (auto SetLayout : key.SetLayouts)
+		{
+			hashCombine(Seed, SetLayout);
+		}
+		for (const auto& Range : key.PushConstantRanges)
+		{
+			hashCombine(Seed, static_cast<uint32_t>(Range.stageFlags), Range.offset, Range.size);
+		}
+		return Seed;
+	}
+
+	VulkanLayoutCache::VulkanLayoutCache(VulkanDevice& device) : Device{device}
+	{
+	}
+
+	VulkanLayoutCache::~VulkanLayoutCache()
+	{
+		for (auto& kv : PipelineLayouts)
+		{
+			vkDestroyPipelineLayout(Device.device(), kv.second, nullptr);
+		}
+	}
+
+	std::shared_ptr<VulkanDescriptorSetLayout> VulkanLayoutCache::GetDescriptorSetLayout(
+		const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding>& bindings)
+	{
+		SetLayoutKey Key{};
+		for (const auto& kv : bindings)
+		{
+			Key.Bindings.push_back(kv.second);
+		}
+		std::sort(Key.Bindings.begin(), Key.Bindings.end(),
+			[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		CacheStats.SetLayoutRequests++;
+
+		auto Found = SetLayouts.find(Key);
+		if (Found != SetLayouts.end())
+		{
+			return Found->second;
+		}
+
+		auto Layout = std::make_shared<VulkanDescriptorSetLayout>(Device, bindings);
+		SetLayouts.emplace(std::move(Key), Layout);
+		CacheStats.SetLayoutsCreated++;
+		return Layout;
+	}
+
+	VkPipelineLayout VulkanLayoutCache::GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts,
+		const std::vector<VkPushConstantRange>& pushConstantRanges)
+	{
+		PipelineLayoutKey Key{ setLayouts, pushConstantRanges };
+
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		CacheStats.PipelineLayoutRequests++;
+
+		auto Found = PipelineLayouts.find(Key);
+		if (Found != PipelineLayouts.end())
+		{
+			return Found->second;
+		}
+
+		VkPipelineLayoutCreateInfo PipelineLayoutInfo{};
+		PipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		PipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		PipelineLayoutInfo.pSetLayouts = setLayouts.data();
+		PipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+		PipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+		VkPipelineLayout Layout;
+		if (vkCreatePipelineLayout(Device.device(), &PipelineLayoutInfo, nullptr, &Layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Pipeline Layout");
+		}
+
+		PipelineLayouts.emplace(std::move(Key), Layout);
+		CacheStats.PipelineLayoutsCreated++;
+		return Layout;
+	}
+
+	VulkanLayoutCache::Stats VulkanLayoutCache::GetStats() const
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		return CacheStats;
+	}
+}
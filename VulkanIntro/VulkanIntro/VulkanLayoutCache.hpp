@@ -0,0 +1,63 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+#include "VulkanDescriptors.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vlkn {
+
+	// Deduplicates descriptor set layouts and pipeline layouts. Requests with identical binding and push
+	// constant descriptions get the same handle back, which keeps pipeline layouts compatible across
+	// render systems. Everything stays alive until the device is destroyed.
+	class VulkanLayoutCache {
+	public:
+		struct Stats {
+			uint32_t SetLayoutRequests = 0;
+			uint32_t SetLayoutsCreated = 0;
+			uint32_t PipelineLayoutRequests = 0;
+			uint32_t PipelineLayoutsCreated = 0;
+		};
+
+		VulkanLayoutCache(VulkanDevice& device);
+		~VulkanLayoutCache();
+
+		VulkanLayoutCache(const VulkanLayoutCache&) = delete;
+		VulkanLayoutCache& operator=(const VulkanLayoutCache&) = delete;
+
+		std::shared_ptr<VulkanDescriptorSetLayout> GetDescriptorSetLayout(
+			const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding>& bindings);
+		VkPipelineLayout GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts,
+			const std::vector<VkPushConstantRange>& pushConstantRanges);
+
+		Stats GetStats() const;
+
+	private:
+		struct SetLayoutKey {
+			// Sorted by binding number so insertion order does not matter.
+			std::vector<VkDescriptorSetLayoutBinding> Bindings;
+			bool operator==(const SetLayoutKey& other) const;
+		};
+
+		struct PipelineLayoutKey {
+			std::vector<VkDescriptorSetLayout> SetLayouts;
+			std::vector<VkPushConstantRange> PushConstantRanges;
+			bool operator==(const PipelineLayoutKey& other) const;
+		};
+
+		struct KeyHash {
+			size_t operator()(const SetLayoutKey& key) const;
+			size_t operator()(const PipelineLayoutKey& key) const;
+		};
+
+		VulkanDevice& Device;
+		std::unordered_map<SetLayoutKey, std::shared_ptr<VulkanDescriptorSetLayout>, KeyHash> SetLayouts;
+		std::unordered_map<PipelineLayoutKey, VkPipelineLayout, KeyHash> PipelineLayouts;
+		Stats CacheStats{};
+		mutable std::mutex Mutex;
+	};
+}
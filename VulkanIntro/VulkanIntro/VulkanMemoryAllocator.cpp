@@ -0,0 +1,346 @@
+#include "VulkanMemoryAllocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace vlkn {
+
+	static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+	}
+
+	static VkDeviceSize AlignDown(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return alignment > 1 ? value / alignment * alignment : value;
+	}
+
+	VulkanMemoryAllocator::VulkanMemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties,
+		const VkPhysicalDeviceLimits& limits, VkDeviceSize blockSize)
+		: Device{device},
+		MemoryProperties{memoryProperties},
+		NonCoherentAtomSize{std::max<VkDeviceSize>(limits.nonCoherentAtomSize, 1)},
+		BlockSize{blockSize}
+	{
+	}
+
+	VulkanMemoryAllocator::~VulkanMemoryAllocator()
+	{
+		for (uint32_t i = 0; i < Blocks.size(); i++)
+		{
+			if (Blocks[i] != nullptr)
+			{
+				assert(Blocks[i]->AllocationCount == 0 && "Memory block still has live allocations on shutdown.");
+				DestroyBlock(i);
+			}
+		}
+		for (auto& kv : DedicatedAllocations)
+		{
+			vkFreeMemory(Device, kv.first, nullptr);
+		}
+	}
+
+	uint32_t VulkanMemoryAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+	{
+		for (uint32_t i = 0; i < MemoryProperties.memoryTypeCount; i++)
+		{
+			if ((typeFilter & (1 << i)) &&
+				(MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return i;
+			}
+		}
+		throw std::runtime_error("Failed to find suitable memory type.");
+	}
+
+	/**
+ * Sub-allocates device memory from a block of the matching memory type. Requests larger than half a
+ * block get their own VkDeviceMemory so they don't pin a mostly empty block.
+ *
+ * @param requirements Requirements reported by vkGet{Buffer,Image}MemoryRequirements
+ * @param properties Required memory property flags
+ * @param kind Whether the resource is a buffer/linear image or an optimally tiled image
+ *
+ * @return The allocation. Host-visible allocations are always mapped.
+ */
+	VulkanAllocation VulkanMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind)
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+
+		uint32_t MemoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, properties);
+		VkMemoryPropertyFlags TypeFlags = MemoryProperties.memoryTypes[MemoryTypeIndex].propertyFlags;
+
+		VkDeviceSize Alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+		VkDeviceSize Size = requirements.size;
+		if ((TypeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(TypeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+		{
+			// Keep flush/invalidate ranges of neighbouring allocations from overlapping.
+			Alignment = std::max(Alignment, NonCoherentAtomSize);
+			Size = AlignUp(Size, NonCoherentAtomSize);
+		}
+
+		VulkanAllocation Allocation{};
+		Allocation.MemoryTypeIndex = MemoryTypeIndex;
+		Allocation.Size = Size;
+
+		VkDeviceSize PreferredSize = PreferredBlockSize(MemoryTypeIndex);
+		if (Size > PreferredSize / 2)
+		{
+			Allocation.Memory = AllocateDeviceMemory(MemoryTypeIndex, Size, &Allocation.Mapped);
+			Allocation.Offset = 0;
+			Allocation.BlockIndex = DEDICATED_BLOCK_INDEX;
+			DedicatedAllocations[Allocation.Memory] = Size;
+			return Allocation;
+		}
+
+		uint32_t BlockIndex = DEDICATED_BLOCK_INDEX;
+		VkDeviceSize Offset = 0;
+		for (uint32_t i = 0; i < Blocks.size(); i++)
+		{
+			auto& Block = Blocks[i];
+			if (Block == nullptr || Block->MemoryTypeIndex != MemoryTypeIndex || Block->Kind != kind) continue;
+			if (AllocateFromBlock(*Block, Size, Alignment, Offset))
+			{
+				BlockIndex = i;
+				break;
+			}
+		}
+
+		if (BlockIndex == DEDICATED_BLOCK_INDEX)
+		{
+			BlockIndex = CreateBlock(MemoryTypeIndex, kind, PreferredSize);
+			bool Success = AllocateFromBlock(*Blocks[BlockIndex], Size, Alignment, Offset);
+			assert(Success && "Fresh memory block could not satisfy allocation.");
+		}
+
+		auto& Block = *Blocks[BlockIndex];
+		Allocation.Memory = Block.Memory;
+		Allocation.Offset = Offset;
+		Allocation.BlockIndex = BlockIndex;
+		Allocation.Mapped = Block.Mapped ? static_cast<char*>(Block.Mapped) + Offset : nullptr;
+		return Allocation;
+	}
+
+	void VulkanMemoryAllocator::Free(VulkanAllocation& allocation)
+	{
+		if (allocation.Memory == VK_NULL_HANDLE) return;
+
+		std::lock_guard<std::mutex> Lock{ Mutex };
+
+		if (allocation.BlockIndex == DEDICATED_BLOCK_INDEX)
+		{
+			DedicatedAllocations.erase(allocation.Memory);
+			vkFreeMemory(Device, allocation.Memory, nullptr);
+		}
+		else
+		{
+			assert(allocation.BlockIndex < Blocks.size() && Blocks[allocation.BlockIndex] != nullptr && "Freeing allocation from unknown block.");
+			auto& Block = *Blocks[allocation.BlockIndex];
+			ReturnToBlock(Block, allocation.Offset, allocation.Size);
+
+			// Keep one empty block per memory type around so a load/unload cycle doesn't thrash vkAllocateMemory.
+			if (Block.AllocationCount == 0)
+			{
+				bool HasSibling = false;
+				for (uint32_t i = 0; i < Blocks.size(); i++)
+				{
+					if (i != allocation.BlockIndex && Blocks[i] != nullptr &&
+						Blocks[i]->MemoryTypeIndex == Block.MemoryTypeIndex && Blocks[i]->Kind == Block.Kind)
+					{
+						HasSibling = true;
+						break;
+					}
+				}
+				if (HasSibling)
+				{
+					DestroyBlock(allocation.BlockIndex);
+				}
+			}
+		}
+		allocation = VulkanAllocation{};
+	}
+
+	VkResult VulkanMemoryAllocator::Flush(const VulkanAllocation& allocation, VkDeviceSize size, VkDeviceSize offset)
+	{
+		return MappedRangeOp(allocation, size, offset, true);
+	}
+
+	VkResult VulkanMemoryAllocator::Invalidate(const VulkanAllocation& allocation, VkDeviceSize size, VkDeviceSize offset)
+	{
+		return MappedRangeOp(allocation, size, offset, false);
+	}
+
+	VulkanMemoryStats VulkanMemoryAllocator::GetStats() const
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+
+		VulkanMemoryStats Stats{};
+		for (auto& Block : Blocks)
+		{
+			if (Block == nullptr) continue;
+			Stats.BlockCount++;
+			Stats.AllocationCount += Block->AllocationCount;
+			Stats.BytesReserved += Block->Size;
+			Stats.BytesInUse += Block->BytesInUse;
+		}
+		for (auto& kv : DedicatedAllocations)
+		{
+			Stats.DedicatedAllocationCount++;
+			Stats.AllocationCount++;
+			Stats.BytesReserved += kv.second;
+			Stats.BytesInUse += kv.second;
+		}
+		Stats.VkAllocationCount = Stats.BlockCount + Stats.DedicatedAllocationCount;
+		return Stats;
+	}
+
+	bool VulkanMemoryAllocator::AllocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+	{
+		// First fit over the free list; the list is ordered by offset, which keeps allocations packed towards the front.
+		for (auto it = block.FreeRanges.begin(); it != block.FreeRanges.end(); ++it)
+		{
+			VkDeviceSize RangeStart = it->first;
+			VkDeviceSize RangeEnd = it->first + it->second;
+			VkDeviceSize AlignedStart = AlignUp(RangeStart, alignment);
+			if (AlignedStart + size > RangeEnd) continue;
+
+			block.FreeRanges.erase(it);
+			if (AlignedStart > RangeStart)
+			{
+				block.FreeRanges[RangeStart] = AlignedStart - RangeStart;
+			}
+			if (AlignedStart + size < RangeEnd)
+			{
+				block.FreeRanges[AlignedStart + size] = RangeEnd - (AlignedStart + size);
+			}
+
+			block.BytesInUse += size;
+			block.AllocationCount++;
+			offset = AlignedStart;
+			return true;
+		}
+		return false;
+	}
+
+	void VulkanMemoryAllocator::ReturnToBlock(MemoryBlock& block, VkDeviceSize offset, VkDeviceSize size)
+	{
+		auto Inserted = block.FreeRanges.emplace(offset, size).first;
+
+		// Coalesce with the following range
+		auto Next = std::next(Inserted);
+		if (Next != block.FreeRanges.end() && Inserted->first + Inserted->second == Next->first)
+		{
+			Inserted->second += Next->second;
+			block.FreeRanges.erase(Next);
+		}
+
+		// Coalesce with the preceding range
+		if (Inserted != block.FreeRanges.begin())
+		{
+			auto Prev = std::prev(Inserted);
+			if (Prev->first + Prev->second == Inserted->first)
+			{
+				Prev->second += Inserted->second;
+				block.FreeRanges.erase(Inserted);
+			}
+		}
+
+		block.BytesInUse -= size;
+		block.AllocationCount--;
+	}
+
+	uint32_t VulkanMemoryAllocator::CreateBlock(uint32_t memoryTypeIndex, ResourceKind kind, VkDeviceSize size)
+	{
+		auto Block = std::make_unique<MemoryBlock>();
+		Block->Memory = AllocateDeviceMemory(memoryTypeIndex, size, &Block->Mapped);
+		Block->Size = size;
+		Block->MemoryTypeIndex = memoryTypeIndex;
+		Block->Kind = kind;
+		Block->FreeRanges[0] = size;
+
+		for (uint32_t i = 0; i < Blocks.size(); i++)
+		{
+			if (Blocks[i] == nullptr)
+			{
+				Blocks[i] = std::move(Block);
+				return i;
+			}
+		}
+		Blocks.push_back(std::move(Block));
+		return static_cast<uint32_t>(Blocks.size() - 1);
+	}
+
+	void VulkanMemoryAllocator::DestroyBlock(uint32_t blockIndex)
+	{
+		auto& Block = Blocks[blockIndex];
+		if (Block->Mapped)
+		{
+			vkUnmapMemory(Device, Block->Memory);
+		}
+		vkFreeMemory(Device, Block->Memory, nullptr);
+		Block.reset();
+	}
+
+	VkDeviceMemory VulkanMemoryAllocator::AllocateDeviceMemory(uint32_t memoryTypeIndex, VkDeviceSize size, void** mapped)
+	{
+		VkMemoryAllocateInfo AllocInfo{};
+		AllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		AllocInfo.allocationSize = size;
+		AllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+		VkDeviceMemory Memory;
+		if (vkAllocateMemory(Device, &AllocInfo, nullptr, &Memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Allocate Device Memory.");
+		}
+
+		*mapped = nullptr;
+		if (MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			// A VkDeviceMemory may only be mapped once, so host-visible memory stays mapped for its whole lifetime.
+			if (vkMapMemory(Device, Memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+			{
+				vkFreeMemory(Device, Memory, nullptr);
+				throw std::runtime_error("Failed to Map Device Memory.");
+			}
+		}
+		return Memory;
+	}
+
+	VkDeviceSize VulkanMemoryAllocator::PreferredBlockSize(uint32_t memoryTypeIndex) const
+	{
+		// Small heaps (e.g. the 256MB host-visible device-local window) get proportionally smaller blocks.
+		VkDeviceSize HeapSize = MemoryProperties.memoryHeaps[MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+		return std::min(BlockSize, AlignUp(HeapSize / 8, NonCoherentAtomSize));
+	}
+
+	VkResult VulkanMemoryAllocator::MappedRangeOp(const VulkanAllocation& allocation, VkDeviceSize size, VkDeviceSize offset, bool flush)
+	{
+		if (MemoryProperties.memoryTypes[allocation.MemoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+		{
+			return VK_SUCCESS;
+		}
+
+		VkDeviceSize MemorySize;
+		{
+			std::lock_guard<std::mutex> Lock{ Mutex };
+			MemorySize = allocation.BlockIndex == DEDICATED_BLOCK_INDEX ? allocation.Size : Blocks[allocation.BlockIndex]->Size;
+		}
+
+		if (size == VK_WHOLE_SIZE)
+		{
+			size = allocation.Size - offset;
+		}
+		VkDeviceSize Start = AlignDown(allocation.Offset + offset, NonCoherentAtomSize);
+		VkDeviceSize End = AlignUp(allocation.Offset + offset + size, NonCoherentAtomSize);
+
+		VkMappedMemoryRange MappedRange{};
+		MappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		MappedRange.memory = allocation.Memory;
+		MappedRange.offset = Start;
+		MappedRange.size = End >= MemorySize ? VK_WHOLE_SIZE : End - Start;
+
+		return flush ? vkFlushMappedMemoryRanges(Device, 1, &MappedRange) : vkInvalidateMappedMemoryRanges(Device, 1, &MappedRange);
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vlkn {
+
+	// A sub-range of a VkDeviceMemory block handed out by VulkanMemoryAllocator.
+	struct VulkanAllocation {
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		VkDeviceSize Offset = 0;
+		VkDeviceSize Size = 0;
+		// Points at Offset inside the block's persistent mapping. Null for non host-visible memory.
+		void* Mapped = nullptr;
+		uint32_t MemoryTypeIndex = 0;
+		uint32_t BlockIndex = 0;
+	};
+
+	struct VulkanMemoryStats {
+		uint32_t BlockCount = 0;
+		uint32_t DedicatedAllocationCount = 0;
+		uint32_t AllocationCount = 0;
+		uint32_t VkAllocationCount = 0;
+		VkDeviceSize BytesReserved = 0;
+		VkDeviceSize BytesInUse = 0;
+	};
+
+	class VulkanMemoryAllocator {
+	public:
+		static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+		static constexpr uint32_t DEDICATED_BLOCK_INDEX = UINT32_MAX;
+
+		// Buffers and linearly tiled images never share a block with optimally tiled images, so
+		// bufferImageGranularity can never be violated between neighbouring sub-allocations.
+		enum class ResourceKind { Linear, Optimal };
+
+		VulkanMemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties,
+			const VkPhysicalDeviceLimits& limits, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+		~VulkanMemoryAllocator();
+
+		VulkanMemoryAllocator(const VulkanMemoryAllocator&) = delete;
+		VulkanMemoryAllocator& operator=(const VulkanMemoryAllocator&) = delete;
+
+		VulkanAllocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind);
+		void Free(VulkanAllocation& allocation);
+
+		VkResult Flush(const VulkanAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+		VkResult Invalidate(const VulkanAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+		VulkanMemoryStats GetStats() const;
+		uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+	private:
+		struct MemoryBlock {
+			VkDeviceMemory Memory = VK_NULL_HANDLE;
+			VkDeviceSize Size = 0;
+			uint32_t MemoryTypeIndex = 0;
+			ResourceKind Kind = ResourceKind::Linear;
+			void* Mapped = nullptr;
+			// Free ranges keyed by offset, value is the size of the range.
+			std::map<VkDeviceSize, VkDeviceSize> FreeRanges;
+			VkDeviceSize BytesInUse = 0;
+			uint32_t AllocationCount = 0;
+		};
+
+		bool AllocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		void ReturnToBlock(MemoryBlock& block, VkDeviceSize offset, VkDeviceSize size);
+		uint32_t CreateBlock(uint32_t memoryTypeIndex, ResourceKind kind, VkDeviceSize size);
+		void DestroyBlock(uint32_t blockIndex);
+		VkDeviceMemory AllocateDeviceMemory(uint32_t memoryTypeIndex, VkDeviceSize size, void** mapped);
+		VkDeviceSize PreferredBlockSize(uint32_t memoryTypeIndex) const;
+		VkResult MappedRangeOp(const VulkanAllocation& allocation, VkDeviceSize size, VkDeviceSize offset, bool flush);
+
+		VkDevice Device;
+		VkPhysicalDeviceMemoryProperties MemoryProperties;
+		VkDeviceSize NonCoherentAtomSize;
+		VkDeviceSize BlockSize;
+
+		std::vector<std::unique_ptr<MemoryBlock>> Blocks;
+		std::map<VkDeviceMemory, VkDeviceSize> DedicatedAllocations;
+		mutable std::mutex Mutex;
+	};
+}
@@ -1,4 +1,6 @@
 %VULKAN_SDK%\Bin\glslc.exe .\shaders\shader.vert -o .\shaders\shader.vert.spv
+%VULKAN_SDK%\Bin\glslc.exe .\shaders\shader_indirect.vert -o .\shaders\shader_indirect.vert.spv
+%VULKAN_SDK%\Bin\glslc.exe .\shaders\shader_instanced.vert -o .\shaders\shader_instanced.vert.spv
 %VULKAN_SDK%\Bin\glslc.exe .\shaders\shader.frag -o .\shaders\shader.frag.spv
 XCOPY .\shaders\*.* ..\x64\Debug\shaders /C /S /D /Y /I
 XCOPY .\models\*.* ..\x64\Debug\models /C /S /D /Y /I
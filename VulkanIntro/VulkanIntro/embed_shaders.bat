@@ -0,0 +1,8 @@
+@echo off
+rem Compiles every shader to a C array initializer for EmbeddedShaders.hpp. Run as a pre-build step.
+setlocal
+cd /d "%~dp0"
+if not exist shaders\generated mkdir shaders\generated
+for %%S in (shader.vert shader_indirect.vert shader_instanced.vert shader.frag) do (
+    "%VULKAN_SDK%\Bin\glslc.exe" shaders\%%S -mfmt=num -o shaders\generated\%%S.inc || exit /b 1
+)
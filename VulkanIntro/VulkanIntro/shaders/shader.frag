@@ -5,6 +5,10 @@ layout(location=2) in vec3 fragNormalWorld;
 
 layout(location = 0) out vec4 OutColor;
 
+// Shader variant toggles, see ShaderVariantKey. Dead branches are removed when the pipeline is built.
+layout(constant_id = 0) const int LIGHT_COUNT = 1;
+layout(constant_id = 2) const bool HAS_NORMALS = true;
+
 layout(set=0, binding=0) uniform GlobalUBO{
 	mat4 projectionViewMatrix;
 	vec4 AmbientLightColor;
@@ -19,12 +23,19 @@ layout(push_constant) uniform Push{
 
 void main()
 {
-	vec3 DirectionToLight = ubo.LightPosition - fragPosWorld;
-	float Attenuation = 1.0/ dot(DirectionToLight, DirectionToLight);
-
-	vec3 LightColor = ubo.LightColor.xyz * ubo.LightColor.w * Attenuation;
 	vec3 AmbientLight = ubo.AmbientLightColor.xyz * ubo.AmbientLightColor.w;
-	vec3 DiffuseLight = LightColor * max(dot(normalize(fragNormalWorld), normalize(DirectionToLight)),0);
+	vec3 DiffuseLight = vec3(0.0);
+
+	if (LIGHT_COUNT > 0)
+	{
+		vec3 DirectionToLight = ubo.LightPosition - fragPosWorld;
+		float Attenuation = 1.0/ dot(DirectionToLight, DirectionToLight);
+
+		vec3 LightColor = ubo.LightColor.xyz * ubo.LightColor.w * Attenuation;
+		// Without normals the light is applied unshaded.
+		float Lambert = HAS_NORMALS ? max(dot(normalize(fragNormalWorld), normalize(DirectionToLight)),0) : 1.0;
+		DiffuseLight = LightColor * Lambert;
+	}
 
 	
 	OutColor = vec4((DiffuseLight + AmbientLight) * fragColor,1.0);
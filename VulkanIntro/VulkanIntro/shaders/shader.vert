@@ -13,6 +13,9 @@ layout(set=0, binding=0) uniform GlobalUBO{
 	vec4 LightColor;
 } ubo;
 
+// Shader variant toggles, see ShaderVariantKey.
+layout(constant_id = 1) const bool HAS_VERTEX_COLOR = true;
+
 layout(location=0) out vec3 fragColor;
 layout(location=1) out vec3 fragPosWorld;
 layout(location=2) out vec3 fragNormalWorld;
@@ -32,5 +35,5 @@ void main()
 
 	fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
 	fragPosWorld = VertexPosition_World.xyz;
-	fragColor = color;
+	fragColor = HAS_VERTEX_COLOR ? color : vec3(1.0);
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+#version 450
+
+layout(location = 0) in vec3 position; 
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec2 uv;
+
+
+layout(set=0, binding=0) uniform GlobalUBO{
+	mat4 projectionViewMatrix;
+	vec4 AmbientLightColor;
+	vec3 LightPosition;
+	vec4 LightColor;
+} ubo;
+
+struct ObjectData {
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+};
+
+// One entry per indirect draw; each draw's firstInstance is its index into this array.
+layout(std430, set=1, binding=0) readonly buffer ObjectBuffer{
+	ObjectData objects[];
+} objectBuffer;
+
+// Shader variant toggles, see ShaderVariantKey.
+layout(constant_id = 1) const bool HAS_VERTEX_COLOR = true;
+
+layout(location=0) out vec3 fragColor;
+layout(location=1) out vec3 fragPosWorld;
+layout(location=2) out vec3 fragNormalWorld;
+
+
+void main()
+{
+	ObjectData object = objectBuffer.objects[gl_InstanceIndex];
+
+	vec4 VertexPosition_World = object.modelMatrix * vec4(position, 1.0);
+	gl_Position = ubo.projectionViewMatrix * VertexPosition_World;
+
+	fragNormalWorld = normalize(mat3(object.normalMatrix) * normal);
+	fragPosWorld = VertexPosition_World.xyz;
+	fragColor = HAS_VERTEX_COLOR ? color : vec3(1.0);
+}
@@ -0,0 +1,36 @@
+#version 450
+
+layout(location = 0) in vec3 position; 
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec2 uv;
+
+// Per-instance data from vertex binding 1, replacing the push constants of shader.vert.
+layout(location = 4) in mat4 instanceModelMatrix;
+layout(location = 8) in mat4 instanceNormalMatrix;
+
+
+layout(set=0, binding=0) uniform GlobalUBO{
+	mat4 projectionViewMatrix;
+	vec4 AmbientLightColor;
+	vec3 LightPosition;
+	vec4 LightColor;
+} ubo;
+
+// Shader variant toggles, see ShaderVariantKey.
+layout(constant_id = 1) const bool HAS_VERTEX_COLOR = true;
+
+layout(location=0) out vec3 fragColor;
+layout(location=1) out vec3 fragPosWorld;
+layout(location=2) out vec3 fragNormalWorld;
+
+
+void main()
+{
+	vec4 VertexPosition_World = instanceModelMatrix * vec4(position, 1.0);
+	gl_Position = ubo.projectionViewMatrix * VertexPosition_World;
+
+	fragNormalWorld = normalize(mat3(instanceNormalMatrix) * normal);
+	fragPosWorld = VertexPosition_World.xyz;
+	fragColor = HAS_VERTEX_COLOR ? color : vec3(1.0);
+}